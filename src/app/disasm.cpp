@@ -115,7 +115,7 @@ auto Disassembler::after() noexcept -> std::string
                             m_cpu.reg.bc,
                             m_cpu.reg.de,
                             m_cpu.reg.hl,
-                            m_cpu.reg.af,
+                            (m_cpu.reg.a << 8) | m_cpu.flags(),
                             m_cpu.reg.sp);
     return disasm;
 }
@@ -12,14 +12,16 @@
 // OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
 // CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
-#include <fstream>
+#include <cstdio>
+#include <cstdlib>
 #include <stdexcept>
+#include <fmt/printf.h>
 #include <qapplication.h>
 #include <qthread.h>
 #include "emulator.h"
 
 /// @brief Initializes the Game Boy system execution interface.
-Emulator::Emulator() noexcept : disasm(bus, cpu)
+Emulator::Emulator() noexcept : disasm(bus, cpu), run_ahead(*this)
 { }
 
 /// @brief Starts the run loop. Does nothing if the loop is already running.
@@ -44,8 +46,9 @@ auto Emulator::pause_run_loop() noexcept -> void
 }
 
 /// @brief Generates a cartridge and sets it up to be executed.
-/// @param The data to use to generate the cartridge.
-auto Emulator::cartridge(const std::vector<uint8_t>& data) -> void
+/// @param rom The ROM image to use to generate the cartridge.
+auto Emulator::cartridge(const std::shared_ptr<const GameBoy::RomImage>& rom)
+-> void
 {
     // We want to stop the run loop if it is running, since the current
     // `m_cart` will be going away if this is successful.
@@ -54,7 +57,7 @@ auto Emulator::cartridge(const std::vector<uint8_t>& data) -> void
 
     try
     {
-        m_cart = cart(data);
+        m_cart = cart(rom);
         reset();
         start_run_loop();
     }
@@ -70,34 +73,59 @@ auto Emulator::cartridge(const std::vector<uint8_t>& data) -> void
     }
 }
 
+/// @brief Sets the number of frames to run ahead by, to hide the input lag of
+/// the game. May be called while the run loop is running.
+/// @param frames The number of frames, 0 to disable run-ahead.
+auto Emulator::set_run_ahead(const unsigned int frames) noexcept -> void
+{
+    run_ahead_frames = frames;
+}
+
+/// @brief Runs the system as fast as possible, rendering only the frames
+/// presented, or at the rate of the LCD again. May be called while the run
+/// loop is running.
+/// @param enabled Fast-forward?
+auto Emulator::set_fast_forward(const bool enabled) noexcept -> void
+{
+    fast_forward = enabled;
+}
+
 /// @brief The starting point for the thread.
+///
+/// If the `GBEMU_FRAME_STATS` environment variable is set, the time between
+/// frames is reported whenever the loop stops.
 auto Emulator::run() -> void
 {
-    std::ofstream trace_file{ "trace.txt" };
+    pacer.reset();
 
     while (running)
     {
-        const auto start{ std::chrono::steady_clock::now() };
-            while (cycles < max_cycles)
+        if (fast_forward)
+        {
+            render_policy(GameBoy::RenderPolicy::EveryNth, FAST_FORWARD_FRAMES);
+
+            for (unsigned int frame{ 0 }; frame < FAST_FORWARD_FRAMES; ++frame)
             {
-                //disasm.before();
-                cycles += step();
-                //trace_file << disasm.after() << std::endl;
+                run_frame();
             }
+            emit render_frame(*bus.ppu.framebuffer);
 
-            cycles -= max_cycles;
-            emit render_frame(bus.ppu.screen_data);
-        const auto end{ std::chrono::steady_clock::now() };
+            // Pick up at the rate of the LCD from here once it's over, rather
+            // than trying to catch up with it.
+            pacer.reset();
+            continue;
+        }
 
-        const auto diff
-        {
-            std::chrono::duration_cast<std::chrono::milliseconds>
-            (end - start).count()
-        };
+        render_policy(GameBoy::RenderPolicy::All);
 
-        if (diff < (1000 / 60))
-        {
-            QThread::msleep((1000 / 60) - diff);
-        }
+        run_ahead.run_frame(run_ahead_frames);
+        emit render_frame(run_ahead.frame());
+
+        pacer.wait();
+    }
+
+    if (std::getenv("GBEMU_FRAME_STATS"))
+    {
+        fmt::fprintf(stderr, "%s", pacer.report());
     }
 }
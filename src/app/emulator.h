@@ -22,9 +22,12 @@
 // Source: https://gcc.gnu.org/onlinedocs/cpp/Pragmas.html
 #pragma once
 
+#include <atomic>
 #include <QThread>
 #include "disasm.h"
+#include "../libgbemu/include/frame_pacer.h"
 #include "../libgbemu/include/gb.h"
+#include "../libgbemu/include/run_ahead.h"
 
 /// @brief Defines the Game Boy system execution interface.
 class Emulator : public QThread, public GameBoy::System
@@ -44,20 +47,26 @@ public:
     auto pause_run_loop() noexcept -> void;
 
     /// @brief Generates a cartridge and sets it up to be executed.
-    /// @param The data to use to generate the cartridge.
-    auto cartridge(const std::vector<uint8_t>& data) -> void;
+    /// @param rom The ROM image to use to generate the cartridge.
+    auto cartridge(const std::shared_ptr<const GameBoy::RomImage>& rom)
+    -> void;
+
+    /// @brief Sets the number of frames to run ahead by, to hide the input
+    /// lag of the game. May be called while the run loop is running.
+    /// @param frames The number of frames, 0 to disable run-ahead.
+    auto set_run_ahead(const unsigned int frames) noexcept -> void;
+
+    /// @brief Runs the system as fast as possible, rendering only the frames
+    /// presented, or at the rate of the LCD again. May be called while the
+    /// run loop is running.
+    /// @param enabled Fast-forward?
+    auto set_fast_forward(const bool enabled) noexcept -> void;
 
 protected:
     /// @brief The starting point for the thread.
     void run() override;
 
 private:
-    /// @brief The maximum number of cycles per execution step.
-    const unsigned int max_cycles{ 4194304 / 60 };
-
-    /// @brief The number of cycles taken by the current execution step.
-    unsigned int cycles{ 0 };
-
     /// @brief Is the emulator running?
     bool running{ false };
 
@@ -67,6 +76,22 @@ private:
     /// @brief Disassembler instance
     Disassembler disasm;
 
+    /// @brief Runs the frames, presenting them from ahead of the system.
+    GameBoy::RunAhead run_ahead;
+
+    /// @brief The number of frames to run ahead by.
+    std::atomic<unsigned int> run_ahead_frames{ 0 };
+
+    /// @brief Holds the run loop to the frame rate of the LCD.
+    GameBoy::FramePacer pacer;
+
+    /// @brief Is the emulator fast-forwarding?
+    std::atomic<bool> fast_forward{ false };
+
+    /// @brief While fast-forwarding, one frame out of this many is rendered
+    /// and presented.
+    static constexpr unsigned int FAST_FORWARD_FRAMES{ 8 };
+
 signals:
     /// @brief Emitted when it is time to play audio samples.
     void play_audio(const std::vector<float>& samples);
@@ -35,28 +35,24 @@ GBEmu::GBEmu() noexcept
     connect(&main_window, &MainWindow::rom_opened,
     [&](const QString& file_name)
     {
-        QFile file(file_name);
+        // The ROM is mapped into memory rather than read, and shared with
+        // any other instance that has it open.
+        std::shared_ptr<const GameBoy::RomImage> rom;
 
-        if (!file.open(QIODevice::ReadOnly))
+        try
         {
-            const auto error_string
-            {
-                QString(tr("Unable to open %1: %2"))
-                .arg(file_name).arg(file.errorString())
-            };
-
-            QMessageBox::critical(&main_window, tr("I/O error"), error_string);
+            rom = GameBoy::RomImage::open
+            (QFile::encodeName(file_name).toStdString());
+        }
+        catch (std::runtime_error& err)
+        {
+            QMessageBox::critical(&main_window, tr("I/O error"), err.what());
             return;
         }
 
-        const auto file_data{ file.readAll() };
-
-        std::vector<uint8_t> rom_data(file_data.begin(), file_data.end());
-        file.close();
-
         try
         {
-            emulator.cartridge(rom_data);
+            emulator.cartridge(rom);
         }
         catch (std::runtime_error& err)
         {
@@ -68,6 +64,18 @@ GBEmu::GBEmu() noexcept
         }
     });
 
+    connect(&main_window, &MainWindow::run_ahead_changed,
+    [&](const unsigned int frames)
+    {
+        emulator.set_run_ahead(frames);
+    });
+
+    connect(&main_window, &MainWindow::fast_forward_changed,
+    [&](const bool enabled)
+    {
+        emulator.set_fast_forward(enabled);
+    });
+
     connect(&main_window, &MainWindow::key_pressed, [&](const int key)
     {
         switch (key)
@@ -12,8 +12,10 @@
 // OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
 // CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
+#include <qactiongroup.h>
 #include <qfiledialog.h>
 #include <QKeyEvent>
+#include <qkeysequence.h>
 #include <qmenubar.h>
 #include "main_window.h"
 
@@ -43,6 +45,42 @@ MainWindow::MainWindow() noexcept
             emit rom_opened(file_name);
         }
     });
+
+    emulation.menu = menuBar()->addMenu(tr("&Emulation"));
+    emulation.run_ahead = emulation.menu->addMenu(tr("Run-ahead"));
+
+    // Running ahead by a frame or two hides the input lag of most games, any
+    // more and the game starts to skip ahead of the input.
+    const auto run_ahead_group{ new QActionGroup(this) };
+
+    for (unsigned int frames{ 0 }; frames <= 3; ++frames)
+    {
+        const auto action
+        {
+            emulation.run_ahead->addAction(frames == 0 ? tr("Off")
+                                                       : tr("%n frame(s)",
+                                                            "",
+                                                            frames))
+        };
+
+        action->setCheckable(true);
+        action->setChecked(frames == 0);
+        run_ahead_group->addAction(action);
+
+        connect(action, &QAction::triggered, [this, frames]()
+        {
+            emit run_ahead_changed(frames);
+        });
+    }
+
+    emulation.fast_forward = emulation.menu->addAction(tr("Fast forward"));
+    emulation.fast_forward->setCheckable(true);
+    emulation.fast_forward->setShortcut(QKeySequence(tr("Ctrl+F")));
+
+    connect(emulation.fast_forward, &QAction::toggled, [this](bool enabled)
+    {
+        emit fast_forward_changed(enabled);
+    });
 }
 
 /// @brief Called when the user presses a key on the keyboard.
@@ -52,6 +52,19 @@ private:
         QAction* open_rom;
     } file;
 
+    // "Emulation" menu
+    struct
+    {
+        /// @brief The actual menu handle.
+        QMenu* menu;
+
+        /// @brief "Run-ahead" submenu
+        QMenu* run_ahead;
+
+        /// @brief "Fast forward" menu item
+        QAction* fast_forward;
+    } emulation;
+
 signals:
     /// @brief Emitted when the user selects a ROM file to run.
     void rom_opened(const QString& file_name);
@@ -61,4 +74,11 @@ signals:
 
     /// @brief Emitted when a key has been released.
     void key_released(const int key);
+
+    /// @brief Emitted when the user selects the number of frames to run
+    /// ahead by.
+    void run_ahead_changed(const unsigned int frames);
+
+    /// @brief Emitted when the user turns fast-forward on or off.
+    void fast_forward_changed(const bool enabled);
 };
\ No newline at end of file
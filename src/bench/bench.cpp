@@ -0,0 +1,331 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+// Measures how fast the emulator core executes instructions.
+//
+// Usage: gbemu_bench [-n instructions] [-i] [ROM...]
+//
+// -i enables idle loop detection, and reports how often it kicked in.
+//
+// Without any ROMs, a set of synthetic ROMs built below is used, so that the
+// results can be compared across machines without distributing any game data.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fmt/printf.h>
+#include "../libgbemu/include/gb.h"
+
+#ifndef GBEMU_BENCH_VARIANT
+#define GBEMU_BENCH_VARIANT "default"
+#endif
+
+/// @brief Defines a benchmark scenario.
+struct Scenario
+{
+    /// @brief The name of the scenario as shown in the results.
+    std::string name;
+
+    /// @brief The ROM to execute.
+    std::vector<uint8_t> rom;
+};
+
+/// @brief Generates a 32KB cartridge image with a valid header, which starts
+/// executing `program` at $0150.
+/// @param program The machine code to place at $0150.
+/// @param type The cartridge type, ROM ONLY by default.
+/// @return The cartridge image.
+static auto make_rom(const std::vector<uint8_t>& program,
+                     const uint8_t type = 0x00) -> std::vector<uint8_t>
+{
+    std::vector<uint8_t> rom(32768, 0x00);
+
+    // $0100: NOP; JP $0150
+    rom[0x0100] = 0x00;
+    rom[0x0101] = 0xC3;
+    rom[0x0102] = 0x50;
+    rom[0x0103] = 0x01;
+
+    rom[0x0147] = type;
+    rom[0x0148] = 0x00; // 32KB
+    rom[0x0149] = 0x00; // No RAM
+
+    unsigned int x{ 0 };
+
+    for (unsigned int i{ 0x0134 }; i <= 0x014C; ++i)
+    {
+        x = x - rom[i] - 1;
+    }
+    rom[0x014D] = x & 0xFF;
+
+    std::copy(program.begin(), program.end(), rom.begin() + 0x0150);
+    return rom;
+}
+
+/// @brief Generates the synthetic scenarios.
+/// @return The scenarios.
+static auto synthetic_scenarios() -> std::vector<Scenario>
+{
+    std::vector<Scenario> scenarios;
+
+    // Register-to-register arithmetic and CB-prefixed instructions, which
+    // stresses instruction dispatch more than anything else.
+    scenarios.push_back({ "alu", make_rom(
+    {
+        0x78,             // loop: LD A, B
+        0x81,             // ADD A, C
+        0x8A,             // ADC A, D
+        0x93,             // SUB E
+        0xA4,             // AND H
+        0xAD,             // XOR L
+        0xB7,             // OR A
+        0xB8,             // CP B
+        0x04,             // INC B
+        0x0D,             // DEC C
+        0x13,             // INC DE
+        0x07,             // RLCA
+        0xCB, 0x11,       // RL C
+        0xCB, 0x7A,       // BIT 7, D
+        0xCB, 0xC3,       // SET 0, E
+        0x27,             // DAA
+        0x18, 0xEB        // JR loop
+    })});
+
+    // Memory accesses, stack operations and calls.
+    scenarios.push_back({ "memory", make_rom(
+    {
+        0x21, 0x00, 0xC0, // loop: LD HL, $C000
+        0x22,             // LD (HL+), A
+        0x7E,             // LD A, (HL)
+        0x34,             // INC (HL)
+        0xC5,             // PUSH BC
+        0xD1,             // POP DE
+        0xEA, 0x80, 0xC1, // LD ($C180), A
+        0xFA, 0x80, 0xC1, // LD A, ($C180)
+        0xE0, 0x80,       // LDH ($FF80), A
+        0xCD, 0x65, 0x01, // CALL sub
+        0x18, 0xEB,       // JR loop
+        0xC9              // sub: RET
+    })});
+
+    // Read-modify-write instructions operating on (HL).
+    scenarios.push_back({ "hl-rmw", make_rom(
+    {
+        0x21, 0x00, 0xC0, // LD HL, $C000
+        0x34,             // loop: INC (HL)
+        0x35,             // DEC (HL)
+        0xCB, 0x06,       // RLC (HL)
+        0xCB, 0x0E,       // RRC (HL)
+        0xCB, 0x16,       // RL (HL)
+        0xCB, 0x1E,       // RR (HL)
+        0xCB, 0x26,       // SLA (HL)
+        0xCB, 0x2E,       // SRA (HL)
+        0xCB, 0x36,       // SWAP (HL)
+        0xCB, 0x3E,       // SRL (HL)
+        0x34,             // INC (HL)
+        0x18, 0xEB        // JR loop
+    })});
+
+    // Cartridge RAM accesses and bank switches, which still go through the
+    // cartridge rather than straight to memory.
+    scenarios.push_back({ "mbc1", make_rom(
+    {
+        0x3E, 0x0A,       // LD A, $0A
+        0xEA, 0x00, 0x00, // LD ($0000), A
+        0x3E, 0x01,       // loop: LD A, $01
+        0xEA, 0x00, 0x20, // LD ($2000), A
+        0x21, 0x00, 0xA0, // LD HL, $A000
+        0x7E,             // LD A, (HL)
+        0x34,             // INC (HL)
+        0xFA, 0x01, 0xA0, // LD A, ($A001)
+        0xEA, 0x02, 0xA0, // LD ($A002), A
+        0x18, 0xEE        // JR loop
+    }, 0x01)});
+
+    // Waiting for V-Blank with HALT, as most games do for most of a frame.
+    auto halt{ make_rom(
+    {
+        0x3E, 0x01,       // LD A, $01
+        0xE0, 0xFF,       // LDH ($FFFF), A
+        0xFB,             // EI
+        0x76,             // loop: HALT
+        0x18, 0xFD        // JR loop
+    })};
+
+    halt[0x0040] = 0xD9;  // V-Blank: RETI
+    scenarios.push_back({ "halt", halt });
+
+    // Waiting for V-Blank by polling LY instead, which only idle loop
+    // detection can speed up.
+    scenarios.push_back({ "ly-poll", make_rom(
+    {
+        0xF0, 0x44,       // loop: LDH A, ($FF44)
+        0xFE, 0x90,       // CP $90
+        0x20, 0xFA,       // JR NZ, loop
+        0xF0, 0x44,       // wait: LDH A, ($FF44)
+        0xFE, 0x90,       // CP $90
+        0x28, 0xFA,       // JR Z, wait
+        0x18, 0xF2        // JR loop
+    })});
+
+    // Filling VRAM with the LCD turned off, as games do behind loading
+    // screens. The PPU should cost next to nothing until it is turned back on.
+    scenarios.push_back({ "lcd-off", make_rom(
+    {
+        0xF0, 0x44,       // wait: LDH A, ($FF44)
+        0xFE, 0x90,       // CP $90
+        0x20, 0xFA,       // JR NZ, wait
+        0xAF,             // XOR A
+        0xE0, 0x40,       // LDH ($FF40), A
+        0x21, 0x00, 0x80, // loop: LD HL, $8000
+        0x22,             // LD (HL+), A
+        0x22,             // LD (HL+), A
+        0x3C,             // INC A
+        0x18, 0xF8        // JR loop
+    })});
+
+    return scenarios;
+}
+
+/// @brief Reads a ROM from disk.
+/// @param path The path of the ROM.
+/// @return The scenario executing the ROM.
+static auto load_scenario(const std::string& path) -> Scenario
+{
+    std::ifstream file{ path, std::ios::binary };
+
+    if (!file)
+    {
+        throw std::runtime_error(fmt::sprintf("Unable to open %s", path));
+    }
+
+    return { path, std::vector<uint8_t>(std::istreambuf_iterator<char>(file),
+                                        std::istreambuf_iterator<char>()) };
+}
+
+/// @brief Execution modes to run every scenario in, along with their names.
+static const std::vector<std::pair<GameBoy::ExecutionMode, std::string>> modes
+{
+    { GameBoy::ExecutionMode::Interpreter,       "interpreter" },
+    { GameBoy::ExecutionMode::CachedInterpreter, "cached"      },
+#ifdef GBEMU_JIT
+    { GameBoy::ExecutionMode::Recompiler,        "recompiler"  }
+#endif
+};
+
+/// @brief Executes a scenario and prints the results.
+/// @param scenario The scenario to execute.
+/// @param mode The execution mode to use, and its name.
+/// @param instructions The number of instructions to execute.
+/// @param idle_loops Enable idle loop detection?
+static auto run(const Scenario& scenario,
+                const std::pair<GameBoy::ExecutionMode, std::string>& mode,
+                const unsigned long long instructions,
+                const bool idle_loops) -> void
+{
+    GameBoy::System gb;
+
+    gb.cart(scenario.rom);
+    gb.reset();
+
+    gb.cpu.mode = mode.first;
+    gb.cpu.idle_loops.enabled = idle_loops;
+
+    unsigned long long cycles{ 0 };
+
+    const auto start{ std::chrono::steady_clock::now() };
+
+    for (unsigned long long i{ 0 }; i < instructions; ++i)
+    {
+        cycles += gb.step();
+    }
+
+    const auto end{ std::chrono::steady_clock::now() };
+    const std::chrono::duration<double> seconds{ end - start };
+
+    // Emulated time relative to real time. The recompiler may execute several
+    // instructions in one step, so this is the figure to compare it by.
+    const double speed{ (cycles / 4194304.0) / seconds.count() };
+
+    fmt::printf("%-28s %-12s %-20s %8.2f MIPS %8.2fx\n",
+                GBEMU_BENCH_VARIANT,
+                mode.second,
+                scenario.name,
+                (instructions / seconds.count()) / 1e6,
+                speed);
+
+    if (idle_loops)
+    {
+        fmt::printf("%-28s %-12s %-20s %llu idle loops skipped, %llu cycles\n",
+                    "",
+                    "",
+                    "",
+                    static_cast<unsigned long long>(gb.cpu.idle_loops.hits),
+                    static_cast<unsigned long long>(
+                    gb.cpu.idle_loops.cycles_skipped));
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned long long instructions{ 50000000 };
+    bool idle_loops{ false };
+    std::vector<Scenario> scenarios;
+
+    try
+    {
+        for (int i{ 1 }; i < argc; ++i)
+        {
+            const std::string arg{ argv[i] };
+
+            if (arg == "-n" && i + 1 < argc)
+            {
+                instructions = std::strtoull(argv[++i], nullptr, 10);
+                continue;
+            }
+
+            if (arg == "-i")
+            {
+                idle_loops = true;
+                continue;
+            }
+            scenarios.push_back(load_scenario(arg));
+        }
+
+        if (scenarios.empty())
+        {
+            scenarios = synthetic_scenarios();
+        }
+
+        for (const auto& scenario : scenarios)
+        {
+            for (const auto& mode : modes)
+            {
+                run(scenario, mode, instructions, idle_loops);
+            }
+        }
+    }
+    catch (std::runtime_error& err)
+    {
+        fmt::fprintf(stderr, "%s\n", err.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,286 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+// Checks that the background and window are rendered pixel for pixel the same
+// as by the original renderer, which looked up every pixel on its own from
+// VRAM. The PPU now expands whole tile rows at once, with AVX2 if the core was
+// built for it, so this is built against a core with and without AVX2.
+//
+// Usage: gbemu_render_check
+//
+// Exits with EXIT_FAILURE if any pixel differs, and with 77 (skipped) if the
+// core was built for AVX2 but the host CPU doesn't support it.
+
+#include <array>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <fmt/printf.h>
+#include "../libgbemu/include/gb.h"
+
+#ifndef GBEMU_RENDER_CHECK_VARIANT
+#define GBEMU_RENDER_CHECK_VARIANT "default"
+#endif
+
+/// @brief Defines the state of the PPU to render a frame with.
+struct Case
+{
+    /// @brief The name of the case as shown in the results.
+    std::string name;
+
+    /// @brief The LCDC register. The LCD and background are always enabled,
+    /// and sprites are always disabled, as they weren't drawn the same way by
+    /// the original renderer.
+    uint8_t LCDC;
+
+    /// @brief The SCX and SCY registers.
+    uint8_t SCX, SCY;
+
+    /// @brief The WX and WY registers.
+    uint8_t WX, WY;
+
+    /// @brief The BGP register.
+    uint8_t BGP;
+
+    /// @brief The seed of the VRAM contents.
+    uint32_t seed;
+};
+
+// Bits of the LCDC register.
+constexpr uint8_t LCD_ENABLED{ 1 << 7 };
+constexpr uint8_t WINDOW_TILE_MAP{ 1 << 6 };
+constexpr uint8_t WINDOW_ENABLED{ 1 << 5 };
+constexpr uint8_t BG_WIN_TILE_DATA{ 1 << 4 };
+constexpr uint8_t BG_TILE_MAP{ 1 << 3 };
+constexpr uint8_t BG_ENABLED{ 1 << 0 };
+
+/// @brief The cases to check.
+static const std::vector<Case> cases
+{
+    // name, LCDC, SCX, SCY, WX, WY, BGP, seed
+    { "unsigned-tiles", BG_WIN_TILE_DATA, 0, 0, 0, 0, 0xE4, 1 },
+    { "signed-tiles", 0, 0, 0, 0, 0, 0xE4, 2 },
+    { "bg-map-9c00", BG_TILE_MAP | BG_WIN_TILE_DATA, 0, 0, 0, 0, 0x1B, 3 },
+    { "fine-scroll", BG_WIN_TILE_DATA, 3, 5, 0, 0, 0xE4, 4 },
+    { "scroll-wrap", 0, 251, 250, 0, 0, 0x93, 5 },
+    { "window", WINDOW_ENABLED, 13, 77, 87, 40, 0xE4, 6 },
+    { "window-map-9c00",
+      WINDOW_ENABLED | WINDOW_TILE_MAP | BG_WIN_TILE_DATA,
+      99, 1, 7, 0, 0x72, 7 },
+    { "window-wx-below-7", WINDOW_ENABLED, 6, 6, 3, 10, 0xE4, 8 },
+    { "window-wx-166", WINDOW_ENABLED | BG_TILE_MAP, 0, 0, 166, 0, 0xD8, 9 },
+    { "window-wx-167", WINDOW_ENABLED, 0, 0, 167, 0, 0xE4, 10 },
+    { "window-wy-144", WINDOW_ENABLED, 0, 0, 50, 144, 0xE4, 11 },
+    { "palette-flat", BG_WIN_TILE_DATA, 17, 33, 0, 0, 0x00, 12 },
+    { "palette-reversed",
+      WINDOW_ENABLED | BG_TILE_MAP, 200, 100, 60, 90, 0x1B, 13 }
+};
+
+/// @brief Generates a 32KB ROM ONLY cartridge image, which disables
+/// interrupts and spins forever.
+/// @return The cartridge image.
+static auto make_rom() -> std::vector<uint8_t>
+{
+    std::vector<uint8_t> rom(32768, 0x00);
+
+    // $0100: NOP; JP $0150
+    rom[0x0100] = 0x00;
+    rom[0x0101] = 0xC3;
+    rom[0x0102] = 0x50;
+    rom[0x0103] = 0x01;
+
+    unsigned int x{ 0 };
+
+    for (unsigned int i{ 0x0134 }; i <= 0x014C; ++i)
+    {
+        x = x - rom[i] - 1;
+    }
+    rom[0x014D] = x & 0xFF;
+
+    rom[0x0150] = 0xF3; // DI
+    rom[0x0151] = 0x18; // loop: JR loop
+    rom[0x0152] = 0xFE;
+
+    return rom;
+}
+
+/// @brief Renders a frame the way the original renderer did, one pixel at a
+/// time straight from VRAM.
+/// @param gb The system to render the frame of.
+/// @param c The case the PPU registers were set up from.
+/// @return The frame.
+static auto reference_frame(GameBoy::System& gb, const Case& c)
+-> GameBoy::ScreenData
+{
+    constexpr std::array<uint32_t, 4> colors
+    {
+        0x00FFFFFF, // White
+        0x00D3D3D3, // Light gray
+        0x00A9A9A9, // Dark gray
+        0x00000000  // Black
+    };
+
+    const auto read = [&gb](const unsigned int address)
+    {
+        return gb.bus.read(static_cast<uint16_t>(address),
+                           GameBoy::AccessType::Direct);
+    };
+
+    const uint8_t LCDC{ static_cast<uint8_t>(c.LCDC | BG_ENABLED) };
+    const uint8_t SCY{ c.SCY };
+    const uint8_t SCX{ c.SCX };
+    const uint8_t BGP{ c.BGP };
+    const uint8_t WY{ c.WY };
+    const uint8_t WX{ c.WX };
+
+    const unsigned int bg_tile_map{ (LCDC & BG_TILE_MAP) ? 0x9C00u : 0x9800u };
+    const unsigned int window_tile_map{ (LCDC & WINDOW_TILE_MAP) ? 0x9C00u
+                                                                 : 0x9800u };
+
+    // Like the original renderer, the window doesn't start left of the screen.
+    const unsigned int window_x{ WX - 7u };
+
+    GameBoy::ScreenData frame{ };
+
+    for (unsigned int LY{ 0 }; LY < GameBoy::SCREEN_Y; ++LY)
+    {
+        for (unsigned int screen_x{ 0 }; screen_x < GameBoy::SCREEN_X;
+             ++screen_x)
+        {
+            unsigned int tile_map;
+            unsigned int offset_x;
+            unsigned int offset_y;
+
+            if ((LCDC & WINDOW_ENABLED) && (WY <= LY) && (screen_x >= window_x))
+            {
+                tile_map = window_tile_map;
+                offset_x = screen_x - window_x;
+                offset_y = LY - WY;
+            }
+            else if (LCDC & BG_ENABLED)
+            {
+                tile_map = bg_tile_map;
+                offset_x = (SCX + screen_x) & 0xFF;
+                offset_y = (SCY + LY) & 0xFF;
+            }
+            else
+            {
+                continue;
+            }
+
+            const uint8_t tile_id
+            {
+                read(tile_map + ((offset_y / 8) * 32) + (offset_x / 8))
+            };
+
+            const unsigned int tile_data
+            {
+                (LCDC & BG_WIN_TILE_DATA)
+                ? 0x8000u + (tile_id * 16u)
+                : 0x8800u + ((static_cast<int8_t>(tile_id) + 128) * 16u)
+            };
+
+            const uint8_t lo{ read(tile_data + ((offset_y % 8) * 2))     };
+            const uint8_t hi{ read(tile_data + ((offset_y % 8) * 2) + 1) };
+
+            const unsigned int bit{ 7 - (offset_x % 8) };
+
+            // The original renderer had the bits of the tile data swapped.
+            const unsigned int number{ (((lo >> bit) & 1u) << 1) |
+                                        ((hi >> bit) & 1u) };
+
+            frame[(LY * GameBoy::SCREEN_X) + screen_x] =
+            colors[(BGP >> (number * 2)) & 3];
+        }
+    }
+    return frame;
+}
+
+/// @brief Renders a case and compares it to the original renderer.
+/// @param gb The system to render with.
+/// @param c The case to check.
+/// @return `true` if every pixel matches, or `false` otherwise.
+static auto check(GameBoy::System& gb, const Case& c) -> bool
+{
+    // VRAM is filled with the LCD off, so that it can be accessed freely.
+    gb.bus.write(0xFF40, 0x00);
+
+    uint32_t state{ c.seed };
+
+    for (unsigned int address{ 0x8000 }; address <= 0x9FFF; ++address)
+    {
+        state = (state * 1103515245) + 12345;
+        gb.bus.write(static_cast<uint16_t>(address), (state >> 16) & 0xFF);
+    }
+
+    gb.bus.write(0xFF42, c.SCY);
+    gb.bus.write(0xFF43, c.SCX);
+    gb.bus.write(0xFF47, c.BGP);
+    gb.bus.write(0xFF4A, c.WY);
+    gb.bus.write(0xFF4B, c.WX);
+    gb.bus.write(0xFF40, c.LCDC | LCD_ENABLED | BG_ENABLED);
+
+    // The LCD is enabled in V-Blank, and frames aren't aligned to the screen,
+    // so only the third frame is sure to be drawn from top to bottom.
+    for (unsigned int frame{ 0 }; frame < 3; ++frame)
+    {
+        gb.run_frame();
+    }
+
+    const GameBoy::ScreenData& actual{ *gb.bus.ppu.framebuffer };
+    const GameBoy::ScreenData expected{ reference_frame(gb, c) };
+
+    for (unsigned int i{ 0 }; i < expected.size(); ++i)
+    {
+        if (actual[i] != expected[i])
+        {
+            fmt::printf("%-20s %-20s FAIL at (%u, %u): %06X, expected %06X\n",
+                        GBEMU_RENDER_CHECK_VARIANT,
+                        c.name,
+                        i % GameBoy::SCREEN_X,
+                        i / GameBoy::SCREEN_X,
+                        actual[i],
+                        expected[i]);
+            return false;
+        }
+    }
+
+    fmt::printf("%-20s %-20s OK\n", GBEMU_RENDER_CHECK_VARIANT, c.name);
+    return true;
+}
+
+int main()
+{
+#ifdef GBEMU_RENDER_CHECK_AVX2
+    if (!__builtin_cpu_supports("avx2"))
+    {
+        fmt::printf("%-20s skipped, the CPU doesn't support AVX2\n",
+                    GBEMU_RENDER_CHECK_VARIANT);
+        return 77;
+    }
+#endif
+
+    GameBoy::System gb;
+
+    gb.cart(make_rom());
+    gb.reset();
+
+    bool passed{ true };
+
+    for (const auto& c : cases)
+    {
+        passed &= check(gb, c);
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,489 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+// Runs a ROM without a display, as fast as possible.
+//
+// Usage: gbemu_headless [options] ROM
+//
+// -f frames      Run for this many frames (default: 3600, one minute).
+// -c cycles      Run until at least this many T-cycles have elapsed, in whole
+//                frames, instead.
+// -m mode        Execution mode: interpreter (default), cached or recompiler.
+// -i             Enable idle loop detection.
+// -o file        Dump the final frame to a binary PPM image.
+// -h             Print a hash of every frame.
+// -s             Print timing statistics.
+// -n instances   Run this many instances of the ROM at once through a
+//                GameBoy::BatchRunner, reporting the aggregate throughput.
+// -t threads     The number of worker threads for -n (default: one per core).
+// -r megabytes   Take a rewind snapshot every frame, keeping this many
+//                megabytes of history, and report what it costs.
+// -a frames      Run ahead by this many frames, hashing and dumping the frames
+//                that would be presented.
+// -p             Pace the frames at the rate of the LCD, as a frontend does,
+//                and report the time between frames.
+// -d frames      Render only one frame out of this many, or none at all if 0.
+//                The hashes and the dump are then of the last frame rendered.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <fmt/printf.h>
+#include "../libgbemu/include/batch.h"
+#include "../libgbemu/include/frame_pacer.h"
+#include "../libgbemu/include/gb.h"
+#include "../libgbemu/include/rewind.h"
+#include "../libgbemu/include/run_ahead.h"
+
+/// @brief The options given on the command line.
+struct Options
+{
+    /// @brief The path of the ROM to run.
+    std::string rom;
+
+    /// @brief The number of frames to run for.
+    unsigned long long frames{ 3600 };
+
+    /// @brief The number of T-cycles to run for, or 0 to run for `frames`.
+    unsigned long long cycles{ 0 };
+
+    /// @brief How instructions are executed.
+    GameBoy::ExecutionMode mode{ GameBoy::ExecutionMode::Interpreter };
+
+    /// @brief Enable idle loop detection?
+    bool idle_loops{ false };
+
+    /// @brief The path to dump the final frame to, if any.
+    std::string output;
+
+    /// @brief Print a hash of every frame?
+    bool hashes{ false };
+
+    /// @brief Print timing statistics?
+    bool stats{ false };
+
+    /// @brief The number of instances to run at once.
+    unsigned long long instances{ 1 };
+
+    /// @brief The number of worker threads to run the instances on, or 0 for
+    /// one per core.
+    unsigned int threads{ 0 };
+
+    /// @brief The size of the rewind history in megabytes, or 0 to not take
+    /// rewind snapshots.
+    unsigned long long rewind{ 0 };
+
+    /// @brief The number of frames to run ahead by.
+    unsigned int run_ahead{ 0 };
+
+    /// @brief Pace the frames at the rate of the LCD?
+    bool pace{ false };
+
+    /// @brief Render one frame out of this many, or none at all if 0.
+    unsigned int render_interval{ 1 };
+};
+
+/// @brief Parses the command line.
+///
+/// This function will throw an `std::runtime_error` if the command line is
+/// invalid.
+/// @param argc The number of arguments.
+/// @param argv The arguments.
+/// @return The options.
+static auto parse_options(const int argc, char* argv[]) -> Options
+{
+    Options options;
+
+    for (int i{ 1 }; i < argc; ++i)
+    {
+        const std::string arg{ argv[i] };
+
+        // Options taking a value.
+        if ((arg == "-f" || arg == "-c" || arg == "-m" || arg == "-o" ||
+             arg == "-n" || arg == "-t" || arg == "-r" || arg == "-a" ||
+             arg == "-d") &&
+            (i + 1 < argc))
+        {
+            const std::string value{ argv[++i] };
+
+            if (arg == "-f")
+            {
+                options.frames = std::strtoull(value.c_str(), nullptr, 10);
+            }
+            else if (arg == "-c")
+            {
+                options.cycles = std::strtoull(value.c_str(), nullptr, 10);
+            }
+            else if (arg == "-o")
+            {
+                options.output = value;
+            }
+            else if (arg == "-n")
+            {
+                options.instances = std::max(std::strtoull(value.c_str(),
+                                                           nullptr,
+                                                           10), 1ULL);
+            }
+            else if (arg == "-r")
+            {
+                options.rewind = std::strtoull(value.c_str(), nullptr, 10);
+            }
+            else if (arg == "-a")
+            {
+                options.run_ahead = static_cast<unsigned int>
+                (std::strtoul(value.c_str(), nullptr, 10));
+            }
+            else if (arg == "-d")
+            {
+                options.render_interval = static_cast<unsigned int>
+                (std::strtoul(value.c_str(), nullptr, 10));
+            }
+            else if (arg == "-t")
+            {
+                options.threads = static_cast<unsigned int>
+                (std::strtoul(value.c_str(), nullptr, 10));
+            }
+            else if (value == "interpreter")
+            {
+                options.mode = GameBoy::ExecutionMode::Interpreter;
+            }
+            else if (value == "cached")
+            {
+                options.mode = GameBoy::ExecutionMode::CachedInterpreter;
+            }
+            else if (value == "recompiler")
+            {
+                options.mode = GameBoy::ExecutionMode::Recompiler;
+            }
+            else
+            {
+                throw std::runtime_error
+                (fmt::sprintf("Unknown execution mode %s", value));
+            }
+            continue;
+        }
+
+        if (arg == "-i")
+        {
+            options.idle_loops = true;
+        }
+        else if (arg == "-h")
+        {
+            options.hashes = true;
+        }
+        else if (arg == "-s")
+        {
+            options.stats = true;
+        }
+        else if (arg == "-p")
+        {
+            options.pace = true;
+        }
+        else if (!arg.empty() && arg[0] != '-' && options.rom.empty())
+        {
+            options.rom = arg;
+        }
+        else
+        {
+            throw std::runtime_error(fmt::sprintf("Invalid argument %s", arg));
+        }
+    }
+
+    if (options.rom.empty())
+    {
+        throw std::runtime_error("Usage: gbemu_headless [-f frames] "
+                                 "[-c cycles] [-m mode] [-i] [-o file] [-h] "
+                                 "[-s] [-n instances] [-t threads] "
+                                 "[-r megabytes] [-a frames] [-p] "
+                                 "[-d frames] ROM");
+    }
+    return options;
+}
+
+/// @brief Computes the 64-bit FNV-1a hash of a frame.
+/// @param screen_data The frame.
+/// @return The hash.
+static auto hash_frame(const GameBoy::ScreenData& screen_data) noexcept
+-> uint64_t
+{
+    uint64_t hash{ 0xCBF29CE484222325 };
+
+    for (const uint32_t pixel : screen_data)
+    {
+        for (unsigned int shift{ 0 }; shift < 32; shift += 8)
+        {
+            hash ^= (pixel >> shift) & 0xFF;
+            hash *= 0x00000100000001B3;
+        }
+    }
+    return hash;
+}
+
+/// @brief Writes a frame to a binary PPM image.
+///
+/// This function will throw an `std::runtime_error` if the file could not be
+/// written.
+/// @param path The path of the image.
+/// @param screen_data The frame, as 32-bit BGRA pixels.
+static auto dump_frame(const std::string& path,
+                       const GameBoy::ScreenData& screen_data) -> void
+{
+    std::FILE* const file{ std::fopen(path.c_str(), "wb") };
+
+    if (!file)
+    {
+        throw std::runtime_error(fmt::sprintf("Unable to open %s", path));
+    }
+
+    fmt::fprintf(file, "P6\n%d %d\n255\n", GameBoy::SCREEN_X,
+                                          GameBoy::SCREEN_Y);
+
+    for (const uint32_t pixel : screen_data)
+    {
+        const uint8_t rgb[]
+        {
+            static_cast<uint8_t>(pixel >> 16),
+            static_cast<uint8_t>(pixel >> 8),
+            static_cast<uint8_t>(pixel)
+        };
+        std::fwrite(rgb, sizeof(rgb), 1, file);
+    }
+
+    if (std::fclose(file) != 0)
+    {
+        throw std::runtime_error(fmt::sprintf("Unable to write %s", path));
+    }
+}
+
+/// @brief Returns the render policy the options ask for.
+/// @param options The options given on the command line.
+/// @return The render policy.
+static auto render_policy(const Options& options) noexcept
+-> GameBoy::RenderPolicy
+{
+    return options.render_interval ? GameBoy::RenderPolicy::EveryNth
+                                   : GameBoy::RenderPolicy::Never;
+}
+
+/// @brief Runs many instances of a ROM at once.
+///
+/// This function will throw an `std::runtime_error` if the ROM could not be
+/// loaded, or the final frame could not be written.
+/// @param options The options given on the command line.
+static auto run_batch(const Options& options) -> void
+{
+    GameBoy::BatchRunner runner{ GameBoy::RomImage::open(options.rom),
+                                 options.instances,
+                                 options.threads };
+
+    for (std::size_t i{ 0 }; i < runner.size(); ++i)
+    {
+        runner.system(i).cpu.mode = options.mode;
+        runner.system(i).cpu.idle_loops.enabled = options.idle_loops;
+        runner.system(i).render_policy(render_policy(options),
+                                       options.render_interval);
+    }
+
+    // Every instance runs whole frames, so a cycle count is rounded up to
+    // frames.
+    const unsigned long long frames
+    {
+        options.cycles ? ((options.cycles + GameBoy::System::CYCLES_PER_FRAME
+                           - 1) / GameBoy::System::CYCLES_PER_FRAME)
+                       : options.frames
+    };
+
+    using Clock = std::chrono::steady_clock;
+    using Seconds = std::chrono::duration<double>;
+
+    const auto start{ Clock::now() };
+
+    for (unsigned long long frame{ 1 }; frame <= frames; ++frame)
+    {
+        const GameBoy::ScreenData* const screens{ runner.step_frames(1) };
+
+        if (options.hashes)
+        {
+            for (std::size_t i{ 0 }; i < runner.size(); ++i)
+            {
+                fmt::printf("frame %llu instance %zu %016llx\n",
+                            frame,
+                            i,
+                            static_cast<unsigned long long>
+                            (hash_frame(screens[i])));
+            }
+        }
+    }
+
+    const Seconds elapsed{ Clock::now() - start };
+
+    if (!options.output.empty())
+    {
+        dump_frame(options.output, runner.framebuffers()[0]);
+    }
+
+    if (options.stats)
+    {
+        const double seconds{ elapsed.count() };
+        const double total{ static_cast<double>(frames) * runner.size() };
+
+        fmt::printf("instances:  %zu\n", runner.size());
+        fmt::printf("threads:    %u\n", runner.threads());
+        fmt::printf("frames:     %llu per instance\n", frames);
+        fmt::printf("time:       %.3f s\n", seconds);
+        fmt::printf("fps:        %.1f total, %.1f per instance\n",
+                    total / seconds,
+                    frames / seconds);
+        fmt::printf("speed:      %.2fx total\n",
+                    ((total * GameBoy::System::CYCLES_PER_FRAME) / 4194304.0) /
+                    seconds);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        const Options options{ parse_options(argc, argv) };
+
+        if (options.instances > 1)
+        {
+            run_batch(options);
+            return EXIT_SUCCESS;
+        }
+
+        GameBoy::System gb;
+
+        gb.cart(GameBoy::RomImage::open(options.rom));
+        gb.reset();
+
+        gb.cpu.mode = options.mode;
+        gb.cpu.idle_loops.enabled = options.idle_loops;
+        gb.render_policy(render_policy(options), options.render_interval);
+
+        std::unique_ptr<GameBoy::RewindBuffer> rewind;
+
+        if (options.rewind)
+        {
+            rewind = std::make_unique<GameBoy::RewindBuffer>
+            (gb, options.rewind * 1024 * 1024);
+        }
+
+        GameBoy::RunAhead run_ahead{ gb };
+        GameBoy::FramePacer pacer;
+
+        using Clock = std::chrono::steady_clock;
+        using Seconds = std::chrono::duration<double>;
+
+        unsigned long long frames{ 0 };
+        unsigned long long cycles{ 0 };
+
+        double slowest_frame{ 0.0 };
+        double fastest_frame{ 0.0 };
+        double rewind_time{ 0.0 };
+
+        const auto start{ Clock::now() };
+
+        while (options.cycles ? (cycles < options.cycles)
+                              : (frames < options.frames))
+        {
+            const auto frame_start{ Clock::now() };
+            cycles += run_ahead.run_frame(options.run_ahead);
+            const Seconds frame_time{ Clock::now() - frame_start };
+
+            slowest_frame = std::max(slowest_frame, frame_time.count());
+            fastest_frame = frames ? std::min(fastest_frame, frame_time.count())
+                                   : frame_time.count();
+            frames++;
+
+            if (rewind)
+            {
+                const auto push_start{ Clock::now() };
+                rewind->push();
+                rewind_time += Seconds{ Clock::now() - push_start }.count();
+            }
+
+            if (options.hashes)
+            {
+                fmt::printf("frame %llu %016llx\n",
+                            frames,
+                            static_cast<unsigned long long>
+                            (hash_frame(run_ahead.frame())));
+            }
+
+            if (options.pace)
+            {
+                pacer.wait();
+            }
+        }
+
+        const Seconds elapsed{ Clock::now() - start };
+
+        if (!options.output.empty())
+        {
+            dump_frame(options.output, run_ahead.frame());
+        }
+
+        if (options.stats)
+        {
+            const double seconds{ elapsed.count() };
+            const double emulated{ cycles / 4194304.0 };
+
+            fmt::printf("frames:     %llu\n", frames);
+            fmt::printf("cycles:     %llu\n", cycles);
+            fmt::printf("time:       %.3f s\n", seconds);
+            fmt::printf("fps:        %.1f\n", frames / seconds);
+            fmt::printf("speed:      %.2fx\n", emulated / seconds);
+            fmt::printf("frame time: %.3f ms avg, %.3f ms min, %.3f ms max\n",
+                        (seconds / std::max(frames, 1ULL)) * 1e3,
+                        fastest_frame * 1e3,
+                        slowest_frame * 1e3);
+
+            if (rewind)
+            {
+                fmt::printf("rewind:     %zu states in %.2f MB, "
+                            "%.2f us per frame (%.2f%%)\n",
+                            rewind->size(),
+                            rewind->used() / (1024.0 * 1024.0),
+                            (rewind_time / std::max(frames, 1ULL)) * 1e6,
+                            (rewind_time / seconds) * 100.0);
+            }
+
+            if (options.idle_loops)
+            {
+                fmt::printf("idle loops: %llu skipped, %llu cycles\n",
+                            static_cast<unsigned long long>
+                            (gb.cpu.idle_loops.hits),
+                            static_cast<unsigned long long>
+                            (gb.cpu.idle_loops.cycles_skipped));
+            }
+        }
+
+        if (options.pace)
+        {
+            fmt::printf("%s", pacer.report());
+        }
+    }
+    catch (std::runtime_error& err)
+    {
+        fmt::fprintf(stderr, "%s\n", err.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
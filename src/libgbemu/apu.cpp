@@ -13,9 +13,19 @@
 // CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #include "apu.h"
+#include "bus.h"
+#include "state.h"
 
 using namespace GameBoy;
 
+/// @brief The number of T-cycles between frame sequencer clocks (512Hz).
+constexpr auto FRAME_SEQUENCER_PERIOD{ 8192 };
+
+/// @brief Initializes the audio processing unit (APU).
+/// @param bus The system bus instance.
+APU::APU(SystemBus& bus) noexcept : m_bus(bus)
+{ }
+
 /// @brief
 /// @param data
 /// @return 0 if sound is disabled, or `data` otherwise.
@@ -92,6 +102,11 @@ auto APU::set_NR52(const uint8_t data) noexcept -> void
     {
         reset();
     }
+    else if (!NR52.enabled)
+    {
+        m_bus.sched.schedule(Event::APUFrameSequencer,
+                             FRAME_SEQUENCER_PERIOD);
+    }
     NR52.enabled = msb;
 }
 
@@ -107,42 +122,55 @@ auto APU::reset() noexcept -> void
     NR51 = { };
     NR52 = { };
 
-    frame_sequencer = 0;
     frame_sequencer_step = 0;
+
+    last_wave_ram_value_written = 0x00;
+    unused_regs = { };
+
+    m_bus.sched.cancel(Event::APUFrameSequencer);
 }
 
-/// @brief Steps the APU by 1 m-cycle.
-auto APU::step() noexcept -> void
+/// @brief Saves or loads the state of the APU.
+///
+/// `samples` is output for the host, and isn't part of the state.
+/// @param state The save state serializer.
+auto APU::serialize(StateSerializer& state) noexcept -> void
 {
-    if (NR52.enabled)
+    state.field(CH1);
+    state.field(CH2);
+    state.field(CH3);
+    state.field(CH4);
+    state.field(NR50);
+    state.field(NR51);
+    state.field(NR52);
+    state.field(frame_sequencer_step);
+    state.field(last_wave_ram_value_written);
+    state.field(unused_regs);
+}
+
+/// @brief Clocks the frame sequencer and schedules the next clock.
+/// @param timestamp The timestamp the frame sequencer was due at.
+auto APU::step(const uint64_t timestamp) noexcept -> void
+{
+    switch (frame_sequencer_step)
     {
-        frame_sequencer += 4;
-
-        if (frame_sequencer == 8192)
-        {
-            switch (frame_sequencer_step)
-            {
-                // Decrement length counters
-                case 0:
-                case 4:
-                    break;
-
-                // Decrement length counters and calculate sweep frequency
-                case 2:
-                case 6:
-                    break;
-
-                // Calculate new volume
-                case 7:
-                    break;
-            }
-        }
-        frame_sequencer = 0;
-        frame_sequencer_step++;
-
-        if (frame_sequencer_step > 7)
-        {
-            frame_sequencer_step = 0;
-        }
+        // Decrement length counters
+        case 0:
+        case 4:
+            break;
+
+        // Decrement length counters and calculate sweep frequency
+        case 2:
+        case 6:
+            break;
+
+        // Calculate new volume
+        case 7:
+            break;
     }
+
+    frame_sequencer_step = (frame_sequencer_step + 1) & 7;
+
+    m_bus.sched.schedule_at(Event::APUFrameSequencer,
+                            timestamp + FRAME_SEQUENCER_PERIOD);
 }
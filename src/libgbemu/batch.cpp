@@ -0,0 +1,311 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <algorithm>
+#include <new>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "batch.h"
+
+using namespace GameBoy;
+
+static_assert((sizeof(ScreenData) % BatchRunner::ARENA_ALIGNMENT) == 0,
+              "framebuffers must not share cache lines");
+
+/// @brief Initializes a runner, with every system running the same ROM image.
+///
+/// This function will throw an `std::runtime_error` if the ROM image can't be
+/// used to generate a cartridge.
+/// @param rom The ROM image to run.
+/// @param instances The number of systems to run.
+/// @param threads The number of worker threads to use, or 0 to use one per
+/// hardware thread, up to one per system.
+/// @param pin_threads Pin each worker thread to a core of its own, where
+/// supported?
+BatchRunner::BatchRunner(const std::shared_ptr<const RomImage>& rom,
+                         const std::size_t instances,
+                         unsigned int threads,
+                         const bool pin_threads) : m_generation(0),
+                                                   m_stop(false),
+                                                   m_frames(0),
+                                                   m_pending(0)
+{
+    const unsigned int cores{ std::max(std::thread::hardware_concurrency(),
+                                       1u) };
+
+    if (threads == 0)
+    {
+        threads = cores;
+    }
+
+    threads = static_cast<unsigned int>
+    (std::max<std::size_t>(std::min<std::size_t>(threads, instances), 1));
+
+    m_arena.reset(static_cast<ScreenData*>
+    (::operator new(std::max<std::size_t>(instances, 1) * sizeof(ScreenData),
+                    std::align_val_t{ ARENA_ALIGNMENT })));
+
+    for (std::size_t i{ 0 }; i < instances; ++i)
+    {
+        new (&m_arena[i]) ScreenData{ };
+    }
+
+    try
+    {
+        m_systems.reserve(instances);
+
+        for (std::size_t i{ 0 }; i < instances; ++i)
+        {
+            auto system{ std::make_unique<System>() };
+
+            system->bus.ppu.framebuffer = &m_arena[i];
+            system->cart(rom);
+            system->reset();
+
+            m_systems.push_back(std::move(system));
+        }
+
+        // Every worker starts out with an equal share of the systems, in
+        // contiguous ranges so that neighbouring framebuffers are written by
+        // the same core.
+        m_ranges = std::make_unique<Range[]>(threads);
+
+        for (unsigned int worker{ 0 }; worker < threads; ++worker)
+        {
+            m_ranges[worker].next = (instances * worker) / threads;
+            m_ranges[worker].end = (instances * (worker + 1)) / threads;
+        }
+
+        m_threads.reserve(threads);
+
+        for (unsigned int worker{ 0 }; worker < threads; ++worker)
+        {
+            m_threads.emplace_back([this, worker, pin_threads, cores]
+            {
+                if (pin_threads)
+                {
+                    pin(worker % cores);
+                }
+                work(worker);
+            });
+        }
+    }
+    catch (...)
+    {
+        stop();
+        throw;
+    }
+}
+
+/// @brief Stops the worker threads.
+BatchRunner::~BatchRunner() noexcept
+{
+    stop();
+}
+
+/// @brief Frees the framebuffer arena.
+/// @param arena The framebuffer arena.
+auto BatchRunner::ArenaDeleter::operator()(ScreenData* arena) const noexcept
+-> void
+{
+    ::operator delete(arena, std::align_val_t{ ARENA_ALIGNMENT });
+}
+
+/// @brief Stops and joins the worker threads.
+auto BatchRunner::stop() noexcept -> void
+{
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        m_stop = true;
+    }
+    m_start.notify_all();
+
+    for (auto& thread : m_threads)
+    {
+        thread.join();
+    }
+    m_threads.clear();
+}
+
+/// @brief Returns the number of systems being run.
+/// @return The number of systems.
+auto BatchRunner::size() const noexcept -> std::size_t
+{
+    return m_systems.size();
+}
+
+/// @brief Returns the number of worker threads.
+/// @return The number of worker threads.
+auto BatchRunner::threads() const noexcept -> unsigned int
+{
+    return static_cast<unsigned int>(m_threads.size());
+}
+
+/// @brief Returns one of the systems, i.e. to configure it.
+///
+/// The systems must not be touched while `step_frames()` is running.
+/// @param index The index of the system.
+/// @return The system.
+auto BatchRunner::system(const std::size_t index) noexcept -> System&
+{
+    return *m_systems[index];
+}
+
+/// @brief Sets the state of the joypad of every system.
+/// @param inputs The buttons held down on each system, as a mask of
+/// `JoypadButton` values, one per system.
+/// @param count The number of entries in `inputs`. Systems past the end keep
+/// their current state.
+auto BatchRunner::set_inputs(const uint8_t* inputs,
+                             const std::size_t count) noexcept -> void
+{
+    const std::size_t n{ std::min(count, m_systems.size()) };
+
+    for (std::size_t i{ 0 }; i < n; ++i)
+    {
+        // The joypad register reads a held button as 0.
+        m_systems[i]->bus.joypad_state = static_cast<uint8_t>(~inputs[i]);
+    }
+}
+
+/// @brief Runs every system for a number of frames.
+/// @param frames The number of frames to run each system for.
+/// @return The framebuffers, one per system, in the same order as the systems.
+auto BatchRunner::step_frames(const unsigned int frames) noexcept
+-> const ScreenData*
+{
+    if (m_systems.empty() || (frames == 0))
+    {
+        return m_arena.get();
+    }
+
+    const std::size_t instances{ m_systems.size() };
+    const unsigned int workers{ threads() };
+
+    for (unsigned int worker{ 0 }; worker < workers; ++worker)
+    {
+        m_ranges[worker].next.store((instances * worker) / workers,
+                                    std::memory_order_relaxed);
+    }
+
+    m_frames = frames;
+    m_pending.store(workers, std::memory_order_relaxed);
+
+    std::unique_lock<std::mutex> lock{ m_mutex };
+
+    m_generation++;
+    m_start.notify_all();
+
+    m_done.wait(lock, [this]
+    {
+        return m_pending.load(std::memory_order_acquire) == 0;
+    });
+    return m_arena.get();
+}
+
+/// @brief Returns the framebuffers, as of the last frame run.
+/// @return The framebuffers, one per system.
+auto BatchRunner::framebuffers() const noexcept -> const ScreenData*
+{
+    return m_arena.get();
+}
+
+/// @brief The function run by each worker thread.
+/// @param worker The index of the worker.
+auto BatchRunner::work(const unsigned int worker) noexcept -> void
+{
+    uint64_t generation{ 0 };
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock{ m_mutex };
+
+            m_start.wait(lock, [this, generation]
+            {
+                return m_stop || (m_generation != generation);
+            });
+
+            if (m_stop)
+            {
+                return;
+            }
+            generation = m_generation;
+        }
+
+        drain(worker);
+
+        if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            // Taking the lock makes sure the caller is either waiting already,
+            // or has yet to check `m_pending`.
+            std::lock_guard<std::mutex> lock{ m_mutex };
+            m_done.notify_one();
+        }
+    }
+}
+
+/// @brief Runs instances until there are none left, starting with the
+/// worker's own range.
+/// @param worker The index of the worker.
+auto BatchRunner::drain(const unsigned int worker) noexcept -> void
+{
+    const unsigned int workers{ threads() };
+
+    for (unsigned int i{ 0 }; i < workers; ++i)
+    {
+        Range& range{ m_ranges[(worker + i) % workers] };
+
+        for (;;)
+        {
+            // Instances are taken from the front of the range by its owner
+            // and thieves alike; the counter running past the end is harmless.
+            const std::size_t index
+            {
+                range.next.fetch_add(1, std::memory_order_relaxed)
+            };
+
+            if (index >= range.end)
+            {
+                break;
+            }
+
+            System& system{ *m_systems[index] };
+
+            for (unsigned int frame{ 0 }; frame < m_frames; ++frame)
+            {
+                system.run_frame();
+            }
+        }
+    }
+}
+
+/// @brief Pins the calling thread to a core.
+/// @param core The index of the core.
+auto BatchRunner::pin(const unsigned int core) noexcept -> void
+{
+#ifdef __linux__
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    static_cast<void>(core);
+#endif
+}
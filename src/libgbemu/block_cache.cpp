@@ -0,0 +1,239 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <algorithm>
+#include "bus.h"
+#include "block_cache.h"
+
+using namespace GameBoy;
+
+/// @brief The bank used to key blocks decoded from the boot ROM.
+constexpr uint32_t BOOT_ROM_BANK{ 0xFFFF };
+
+/// @brief The maximum number of instructions in a block.
+constexpr std::size_t MAX_BLOCK_LENGTH{ 32 };
+
+/// @brief Returns the length of an instruction.
+/// @param opcode The opcode of the instruction.
+/// @return The length of the instruction in bytes.
+static constexpr auto instruction_length(const uint8_t opcode) noexcept
+-> unsigned int
+{
+    switch (opcode)
+    {
+        case 0x06: case 0x0E: case 0x16: case 0x1E: // LD r, $imm8
+        case 0x26: case 0x2E: case 0x36: case 0x3E:
+        case 0x18: case 0x20: case 0x28: case 0x30: // JR
+        case 0x38:
+        case 0xC6: case 0xCE: case 0xD6: case 0xDE: // ALU A, $imm8
+        case 0xE6: case 0xEE: case 0xF6: case 0xFE:
+        case 0xE0: case 0xF0:                       // LDH
+        case 0xE8: case 0xF8:                       // ADD SP / LD HL, SP+$simm8
+        case 0xCB:                                  // CB prefix
+            return 2;
+
+        case 0x01: case 0x11: case 0x21: case 0x31: // LD rr, $imm16
+        case 0x08:                                  // LD ($imm16), SP
+        case 0xC2: case 0xC3: case 0xCA: case 0xD2: // JP
+        case 0xDA:
+        case 0xC4: case 0xCC: case 0xCD: case 0xD4: // CALL
+        case 0xDC:
+        case 0xEA: case 0xFA:                       // LD ($imm16) / LD A, ($imm16)
+            return 3;
+
+        default:
+            return 1;
+    }
+}
+
+/// @brief Determines if an instruction ends a block.
+/// @param opcode The opcode of the instruction.
+/// @return `true` if the instruction may transfer control, or `false`
+/// otherwise.
+static constexpr auto ends_block(const uint8_t opcode) noexcept -> bool
+{
+    switch (opcode)
+    {
+        case 0x18: case 0x20: case 0x28: case 0x30: // JR
+        case 0x38:
+        case 0xC2: case 0xC3: case 0xCA: case 0xD2: // JP
+        case 0xDA: case 0xE9:
+        case 0xC4: case 0xCC: case 0xCD: case 0xD4: // CALL
+        case 0xDC:
+        case 0xC0: case 0xC8: case 0xC9: case 0xD0: // RET, RETI
+        case 0xD8: case 0xD9:
+        case 0xC7: case 0xCF: case 0xD7: case 0xDF: // RST
+        case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+        case 0x76:                                  // HALT
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/// @brief Initializes the block cache.
+/// @param bus The current system bus instance.
+BlockCache::BlockCache(SystemBus& bus) noexcept : m_bus(bus)
+{ }
+
+/// @brief Discards all blocks.
+auto BlockCache::clear() noexcept -> void
+{
+    rom_blocks.clear();
+    invalidate_ram();
+}
+
+/// @brief Discards all blocks decoded from WRAM and HRAM.
+auto BlockCache::invalidate_ram() noexcept -> void
+{
+    ram_blocks.clear();
+    m_bus.code_chunks.fill(false);
+}
+
+/// @brief Returns the block starting at an address, decoding it first if
+/// necessary.
+/// @param pc The address of the block.
+/// @return The block, or `nullptr` if code at `pc` can't be cached.
+auto BlockCache::find(const uint16_t pc) noexcept -> BasicBlock*
+{
+    switch (pc >> 12)
+    {
+        case 0x0 ... 0x7:
+        {
+            uint32_t bank;
+            unsigned int end;
+
+            if (pc < 0x0100 && m_bus.boot_rom_mapped())
+            {
+                bank = BOOT_ROM_BANK;
+                end  = 0x0100;
+            }
+            else if (pc < 0x4000)
+            {
+                bank = 0;
+                end  = 0x4000;
+            }
+            else
+            {
+                bank = m_bus.rom_bank();
+                end  = 0x8000;
+            }
+
+            const uint32_t key{ (bank << 16) | pc };
+            auto block{ rom_blocks.find(key) };
+
+            if (block == rom_blocks.end())
+            {
+                block = rom_blocks.emplace(key, decode(pc, end)).first;
+            }
+            return block->second.instructions.empty() ? nullptr
+                                                      : &block->second;
+        }
+
+        case 0xC ... 0xD:
+        case 0xF:
+        {
+            if (pc < 0xC000 || (pc >= 0xE000 && pc < 0xFF80) || pc == 0xFFFF)
+            {
+                return nullptr;
+            }
+
+            auto block{ ram_blocks.find(pc) };
+
+            if (block == ram_blocks.end())
+            {
+                const unsigned int end{ pc < 0xE000 ? 0xE000u : 0xFFFFu };
+                block = ram_blocks.emplace(pc, decode(pc, end)).first;
+
+                const auto& instructions{ block->second.instructions };
+
+                if (!instructions.empty())
+                {
+                    const auto& last{ instructions.back() };
+                    const unsigned int first_chunk{ SystemBus::code_chunk(pc) };
+                    const unsigned int last_chunk
+                    {
+                        SystemBus::code_chunk(last.pc + last.length - 1)
+                    };
+
+                    std::fill(m_bus.code_chunks.begin() + first_chunk,
+                              m_bus.code_chunks.begin() + last_chunk + 1,
+                              true);
+                }
+            }
+            return block->second.instructions.empty() ? nullptr
+                                                      : &block->second;
+        }
+
+        // Code in VRAM and external RAM is rare enough that it's not worth
+        // tracking writes to it.
+        default:
+            return nullptr;
+    }
+}
+
+/// @brief Decodes a block.
+/// @param pc The address of the block.
+/// @param end The first address after the memory region `pc` is in.
+/// @return The decoded block, which may be empty.
+auto BlockCache::decode(uint16_t pc, const unsigned int end) noexcept
+-> BasicBlock
+{
+    BasicBlock block;
+
+    while (block.instructions.size() < MAX_BLOCK_LENGTH)
+    {
+        const uint8_t opcode{ m_bus.read(pc, AccessType::Direct) };
+        const unsigned int length{ instruction_length(opcode) };
+
+        // Instructions straddling the end of a memory region are left to the
+        // interpreter.
+        if (pc + length > end)
+        {
+            break;
+        }
+
+        DecodedInstruction instruction;
+
+        instruction.pc      = pc;
+        instruction.operand = 0;
+        instruction.handler = opcode;
+        instruction.length  = length;
+        instruction.cycles  = length * 4;
+
+        if (opcode == 0xCB)
+        {
+            instruction.handler = 0x100 | m_bus.read(pc + 1, AccessType::Direct);
+        }
+        else if (length == 2)
+        {
+            instruction.operand = m_bus.read(pc + 1, AccessType::Direct);
+        }
+        else if (length == 3)
+        {
+            instruction.operand = (m_bus.read(pc + 2, AccessType::Direct) << 8) |
+                                   m_bus.read(pc + 1, AccessType::Direct);
+        }
+
+        block.instructions.push_back(instruction);
+
+        if (ends_block(opcode))
+        {
+            break;
+        }
+        pc += length;
+    }
+    return block;
+}
@@ -14,17 +14,91 @@
 
 #include "bus.h"
 #include "cart.h"
+#include "state.h"
+
+#ifdef GBEMU_STATIC_CART
+#include "../cart/mbc1.h"
+#include "../cart/mbc3.h"
+#include "../cart/rom_only.h"
+#endif
 
 using namespace GameBoy;
 
-SystemBus::SystemBus() noexcept : timer(*this), ppu(*this)
-{ }
+/// @brief The number of T-cycles an OAM DMA transfer takes to complete.
+constexpr auto DMA_CYCLES{ 640 };
+
+/// @brief Determines if a memory address belongs to a device.
+/// @param address The memory address to check.
+/// @return `true` if the address is in VRAM or in the I/O register area
+/// (including IE), or `false` otherwise.
+static constexpr auto device_address(const uint16_t address) noexcept -> bool
+{
+    return ((address >= 0x8000) && (address <= 0x9FFF)) ||
+           ((address >= 0xFE00) && (address <= 0xFF7F)) ||
+            (address == 0xFFFF);
+}
+
+/// @brief Calls a function with a cartridge.
+///
+/// If `GBEMU_STATIC_CART` is defined, the cartridge is passed as its final
+/// type, so that the calls the function makes through it are resolved at
+/// compile time and can be inlined rather than going through the vtable.
+/// @param cart The cartridge.
+/// @param function The function to call.
+/// @return The value returned by the function.
+template<class Function>
+static auto with_cart(Cartridge& cart, const Function& function) noexcept
+{
+#ifdef GBEMU_STATIC_CART
+    switch (cart.kind)
+    {
+        case CartKind::ROMOnly:
+            return function(static_cast<ROMOnlyCartridge&>(cart));
+
+        case CartKind::MBC1:
+            return function(static_cast<MBC1Cartridge&>(cart));
+
+        case CartKind::MBC3:
+            return function(static_cast<MBC3Cartridge&>(cart));
+    }
+#endif
+    return function(cart);
+}
+
+/// @brief Returns a byte from the cartridge.
+/// @param address The memory address to read from.
+/// @return The byte from the cartridge.
+auto SystemBus::cart_read(const uint16_t address) noexcept -> uint8_t
+{
+    return with_cart(*m_cart, [address](auto& cart)
+    {
+        return cart.read(address);
+    });
+}
+
+/// @brief Updates the memory bank controller configuration.
+/// @param address The configuration area to update.
+/// @param data The value to update the area with.
+auto SystemBus::cart_write(const uint16_t address,
+                           const uint8_t data) noexcept -> void
+{
+    with_cart(*m_cart, [address, data](auto& cart)
+    {
+        cart.write(address, data);
+    });
+}
+
+SystemBus::SystemBus() noexcept : apu(*this), ppu(*this), timer(*this)
+{
+    map_pages();
+}
 
 /// @brief Sets the current cartridge.
 /// @param cart The cartridge to set.
 auto SystemBus::cart(const std::shared_ptr<Cartridge>& cart) noexcept -> void
 {
     m_cart = cart;
+    map_pages();
 }
 
 /// @brief Sets the current boot ROM.
@@ -33,29 +107,225 @@ auto SystemBus::cart(const std::shared_ptr<Cartridge>& cart) noexcept -> void
 auto SystemBus::boot_rom(const std::vector<uint8_t>& data) noexcept -> void
 {
     m_boot_rom = data;
+    map_pages();
+}
+
+/// @brief Returns the ROM bank currently mapped to $4000 - $7FFF.
+/// @return The ROM bank.
+auto SystemBus::rom_bank() noexcept -> unsigned int
+{
+    return m_cart->current_rom_bank();
+}
+
+/// @brief Determines if the boot ROM is mapped to $0000 - $00FF.
+/// @return `true` if the boot ROM is mapped, or `false` otherwise.
+auto SystemBus::boot_rom_mapped() const noexcept -> bool
+{
+    return !m_boot_rom.empty() && !boot_rom_disabled;
+}
+
+/// @brief Determines if a cartridge is set.
+/// @return `true` if a cartridge is set, or `false` otherwise.
+auto SystemBus::has_cart() const noexcept -> bool
+{
+    return m_cart != nullptr;
 }
 
 /// @brief Resets the devices to their startup state and clears all memory.
 auto SystemBus::reset() noexcept -> void
 {
+    // This must come first, as the devices schedule their initial events.
+    sched.reset();
+
     apu.reset();
     ppu.reset();
     timer.reset();
 
+    hram = { };
+
+    joypad = { };
     joypad_state = 0xFF;
 
+    interrupt_enable = { };
+    interrupt_flag = { };
+
     cycles = 0;
     boot_rom_disabled = false;
+
+    code_chunks.fill(false);
+    ram_code_generation = 0;
+    rom_generation = 0;
+    events_dispatched = 0;
+    dma_source = 0x0000;
+
+    map_pages();
+}
+
+/// @brief Saves or loads the state of the bus, the devices and the cartridge.
+///
+/// The ROM and boot ROM are not part of the state, as they never change.
+/// @param state The save state serializer.
+auto SystemBus::serialize(StateSerializer& state) noexcept -> void
+{
+    wram.serialize(state);
+    state.field(hram);
+    state.field(joypad);
+    state.field(joypad_state);
+    state.field(interrupt_enable);
+    state.field(interrupt_flag);
+    state.field(cycles);
+    state.field(dma_source);
+    state.field(boot_rom_disabled);
+
+    sched.serialize(state);
+    apu.serialize(state);
+    ppu.serialize(state);
+    timer.serialize(state);
+
+    if (m_cart)
+    {
+        m_cart->serialize(state);
+    }
+
+    if (state.loading())
+    {
+        // Anything in RAM or mapped to $0000 - $7FFF may be different now.
+        ram_code_generation++;
+        rom_generation++;
+
+        map_pages();
+    }
+}
+
+/// @brief Shares the memory of another bus until either writes to it, and
+/// takes a copy of its cartridge and boot ROM, for a forked system. The state
+/// of the devices is left untouched.
+/// @param parent The bus to share the memory of.
+auto SystemBus::share_memory(const SystemBus& parent) -> void
+{
+    wram = parent.wram;
+    ppu.vram = parent.ppu.vram;
+
+    m_boot_rom = parent.m_boot_rom;
+    m_cart = parent.m_cart ? parent.m_cart->clone() : nullptr;
+
+    ppu.vram_changed();
+    map_pages();
+}
+
+/// @brief Points the page table at the memory currently mapped.
+auto SystemBus::map_pages() noexcept -> void
+{
+    read_pages.fill(nullptr);
+
+    if (m_cart)
+    {
+        for (unsigned int page{ 0x0 }; page <= 0x7; ++page)
+        {
+            read_pages[page] = with_cart(*m_cart, [page](auto& cart)
+            {
+                return cart.rom_page(page);
+            });
+        }
+    }
+
+    if (boot_rom_mapped())
+    {
+        read_pages[0x0] = nullptr;
+    }
+
+    // Writes to VRAM must go through `write()`, so that the PPU can tell
+    // which tiles changed.
+    read_pages[0x8] = ppu.vram.page(0x0);
+    read_pages[0x9] = ppu.vram.page(0x1);
+
+    // Writes to WRAM must go through `write()`, in case code was decoded from
+    // there.
+    read_pages[0xC] = wram.page(0x0);
+    read_pages[0xD] = wram.page(0x1);
 }
 
-/// @brief Advances the devices by 1 m-cycle.
+/// @brief Advances the master clock by 1 m-cycle.
+///
+/// The devices are not brought up to date until the next call to `sync()`.
 auto SystemBus::step() noexcept -> void
 {
     cycles += 4;
+    sched.timestamp += 4;
+}
+
+/// @brief Advances the master clock by a number of T-cycles.
+///
+/// The devices are not brought up to date until the next call to `sync()`.
+/// @param count The number of T-cycles to advance by.
+auto SystemBus::advance(const unsigned int count) noexcept -> void
+{
+    cycles += count;
+    sched.timestamp += count;
+}
+
+/// @brief Brings the devices up to date by dispatching all events that are
+/// due.
+auto SystemBus::sync() noexcept -> void
+{
+    if (sched.due())
+    {
+        dispatch_events();
+    }
+}
+
+/// @brief Dispatches all events that are due to their devices.
+auto SystemBus::dispatch_events() noexcept -> void
+{
+    const auto now{ sched.timestamp };
+
+    for (;;)
+    {
+        sched.timestamp = now;
+
+        uint64_t timestamp;
+        const auto event{ sched.pop_due(timestamp) };
+
+        if (event == Event::None)
+        {
+            break;
+        }
+
+        // Events may be dispatched later than they were due, so the clock is
+        // wound back for the duration of the handler. This keeps anything the
+        // handler reads or schedules relative to the time the event was due.
+        sched.timestamp = timestamp;
+        events_dispatched++;
+
+        switch (event)
+        {
+            case Event::APUFrameSequencer: apu.step(timestamp); break;
+            case Event::PPUModeChange:     ppu.step(timestamp); break;
+            case Event::TimerOverflow:     timer.step();        break;
+            case Event::DMACompletion:     dma_transfer();      break;
+            case Event::None:                                   break;
+        }
+    }
+}
 
-    apu.step();
-    ppu.step();
-    timer.step();
+/// @brief Notes a write to WRAM or HRAM, in case cached code was decoded from
+/// the address.
+/// @param address The address written to.
+auto SystemBus::code_write(const uint16_t address) noexcept -> void
+{
+    if (code_chunks[code_chunk(address)])
+    {
+        ram_code_generation++;
+    }
+}
+
+/// @brief Copies the OAM DMA source page to OAM.
+auto SystemBus::dma_transfer() noexcept -> void
+{
+    for (auto index{ 0 }; index < 160; ++index)
+    {
+        ppu.oam[index] = read(dma_source + index, AccessType::Direct);
+    }
 }
 
 /// @brief Request an interrupt.
@@ -69,7 +339,8 @@ auto SystemBus::irq(const Interrupt interrupt) noexcept -> void
 /// @param address The address to read from.
 /// @param type
 /// 
-/// `AccessType::Emulated` (default): Steps the devices by 1 m-cycle.
+/// `AccessType::Emulated` (default): Steps the devices by 1 m-cycle, and
+/// brings them up to date if the address belongs to one of them.
 /// `AccessType::Direct`: Does not step the devices.
 /// @return The byte from memory.
 auto SystemBus::read(const uint16_t address,
@@ -78,6 +349,18 @@ auto SystemBus::read(const uint16_t address,
     if (type == AccessType::Emulated)
     {
         step();
+
+        // No device can observe reads from ROM, WRAM or HRAM, so the devices
+        // are left behind until one of them is accessed.
+        if (device_address(address))
+        {
+            sync();
+        }
+    }
+
+    if (const uint8_t* const page{ read_pages[address >> 12] })
+    {
+        return page[address & 0x0FFF];
     }
 
     switch (address >> 12)
@@ -90,13 +373,11 @@ auto SystemBus::read(const uint16_t address,
             {
                 return m_boot_rom[address];
             }
-            return m_cart->read(address);
+            return cart_read(address);
         }
 
-        case 0x1 ... 0x7: return m_cart->read(address);
-        case 0x8 ... 0x9: return ppu.vram[address - 0x8000];
-        case 0xA ... 0xB: return m_cart->read(address);
-        case 0xC ... 0xD: return wram[address - 0xC000];
+        case 0x1 ... 0x7: return cart_read(address);
+        case 0xA ... 0xB: return cart_read(address);
 
         case 0xF:
             switch (address & 0x0FFF)
@@ -115,8 +396,8 @@ auto SystemBus::read(const uint16_t address,
                     return 0xFF;
                 }
 
-                case 0xF04:           return timer.DIV;
-                case 0xF05:           return timer.TIMA;
+                case 0xF04:           return timer.get_DIV();
+                case 0xF05:           return timer.get_TIMA();
                 case 0xF0F:           return interrupt_flag.byte;
                 case 0xF10:           return apu.CH1.NR10.byte | 0x80;
                 case 0xF11:           return apu.CH1.NR11.byte | 0x3F;
@@ -163,20 +444,41 @@ auto SystemBus::read(const uint16_t address,
     }
 }
 
-/// @brief Stores a byte into memory.
+/// @brief Stores a byte into memory, stepping the devices by 1 m-cycle and
+/// bringing them up to date.
 /// @param address The address to write to.
 /// @param data The data to store at the address.
 auto SystemBus::write(const uint16_t address,
                       const uint8_t data) noexcept -> void
 {
+    // Unlike reads, every write brings the devices up to date: a pending OAM
+    // DMA transfer must not see data written after it has completed.
     step();
+    sync();
 
     switch (address >> 12)
     {
-        case 0x0 ... 0x7: m_cart->write(address, data);      return;
-        case 0x8 ... 0x9: ppu.vram[address - 0x8000] = data; return;
-        case 0xA ... 0xB: m_cart->write(address, data);      return;
-        case 0xC ... 0xD: wram[address - 0xC000] = data;     return;
+        case 0x0 ... 0x7:
+            cart_write(address, data);
+            rom_generation++;
+            map_pages();
+            return;
+
+        case 0xA ... 0xB: cart_write(address, data); return;
+
+        case 0x8 ... 0x9:
+            // The page is copied if it was shared with a forked system.
+            ppu.vram_write(address, data);
+            read_pages[address >> 12] = ppu.vram.page((address >> 12) - 0x8);
+            return;
+
+        case 0xC ... 0xD:
+            // The page is copied if it was shared with a forked system.
+            wram.write(address - 0xC000, data);
+            read_pages[address >> 12] = wram.page((address >> 12) - 0xC);
+
+            code_write(address);
+            return;
 
         case 0xF:
             switch (address & 0x0FFF)
@@ -184,10 +486,10 @@ auto SystemBus::write(const uint16_t address,
                 case 0xF00:           joypad.byte = data;                               return;
                 case 0xF01:           printf("%c", data);                               return;
                 case 0xF02:                                                             return;
-                case 0xF04:           timer.DIV = 0;                                    return;
-                case 0xF05:           timer.TIMA = data;                                return;
-                case 0xF06:           timer.TMA = data;                                 return;
-                case 0xF07:           timer.TAC.byte = data;                            return;
+                case 0xF04:           timer.set_DIV();                                  return;
+                case 0xF05:           timer.set_TIMA(data);                             return;
+                case 0xF06:           timer.set_TMA(data);                              return;
+                case 0xF07:           timer.set_TAC(data);                              return;
                 case 0xF0F:           interrupt_flag.byte = data;                       return;
                 case 0xF10:           apu.CH1.NR10.byte = apu.set_register_check(data); return;
                 case 0xF11:           apu.CH1.NR11.byte = apu.set_register_check(data); return;
@@ -214,29 +516,35 @@ auto SystemBus::write(const uint16_t address,
                 case 0xF27 ... 0xF2F:                                                   return;
                 case 0xF30 ... 0xF3F: apu.set_wave_ram(address, data);                  return;
                 case 0xF40:           ppu.set_LCDC(data);                               return;
-                case 0xF41:           ppu.STAT.byte = data;                             return;
+                case 0xF41:           ppu.set_STAT(data);                               return;
                 case 0xF42:           ppu.SCY = data;                                   return;
                 case 0xF43:           ppu.SCX = data;                                   return;
 
                 // $FF46 - DMA - DMA Transfer and Start Address(W)
+                //
+                // The CPU keeps running while the transfer is in progress;
+                // OAM is updated all at once when it completes.
                 case 0xF46:
-                {
-                    const auto addr{ data * 0x100 };
-
-                    for (auto index{ 0 }; index < 160; ++index)
-                    {
-                        ppu.oam[index] = read(addr + index);
-                    }
+                    dma_source = data * 0x100;
+                    sched.schedule(Event::DMACompletion, DMA_CYCLES);
                     return;
-                }
 
                 case 0xF47:           ppu.BGP.byte = data;           return;
                 case 0xF48:           ppu.OBP0.byte = data;          return;
                 case 0xF49:           ppu.OBP1.byte = data;          return;
                 case 0xF4A:           ppu.WY = data;                 return;
                 case 0xF4B:           ppu.WX = data;                 return;
-                case 0xF50:           boot_rom_disabled = true;      return;
-                case 0xF80 ... 0xFFE: hram[address - 0xFF80] = data; return;
+                case 0xF50:
+                    boot_rom_disabled = true;
+                    rom_generation++;
+                    map_pages();
+                    return;
+
+                case 0xF80 ... 0xFFE:
+                    hram[address - 0xFF80] = data;
+                    code_write(address);
+                    return;
+
                 case 0xFFF:           interrupt_enable.byte = data;  return;
                 default:              printf("$%04X<-$%02X\n", address, data); return;
             }
@@ -13,18 +13,18 @@
 // CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #include "mbc1.h"
+#include "../include/state.h"
 
 using namespace GameBoy;
 
-MBC1Cartridge::MBC1Cartridge(const std::vector<uint8_t>& data) noexcept :
-Cartridge(data)
+MBC1Cartridge::MBC1Cartridge
+(const std::shared_ptr<const RomImage>& rom) noexcept :
+Cartridge(rom, CartKind::MBC1)
 {
     banking_mode = BankingMode::ROM;
 
     rom_bank.byte = 0x01;
     ram_bank      = 0x00;
-    
-    ram = { };
 }
 
 /// @brief Returns a byte from the cartridge.
@@ -56,6 +56,10 @@ auto MBC1Cartridge::read(const uint16_t address) noexcept -> uint8_t
         // positions or high score tables, even if the GameBoy is turned off,
         // or if the cartridge is removed from the GameBoy.
         case 0xA ... 0xB:
+            if (ram_bank >= RAM_BANKS)
+            {
+                return 0xFF;
+            }
             return ram[(address - 0xA000) + (ram_bank * 0x2000)];
 
         default:
@@ -127,4 +131,44 @@ auto MBC1Cartridge::write(const uint16_t address,
             banking_mode = value == 0x00 ? BankingMode::ROM : BankingMode::RAM;
             return;
     }
-}
\ No newline at end of file
+}
+
+/// @brief Returns the ROM bank currently mapped to $4000 - $7FFF.
+/// @return The ROM bank.
+auto MBC1Cartridge::current_rom_bank() noexcept -> unsigned int
+{
+    return rom_bank.byte;
+}
+
+/// @brief Returns the ROM data currently mapped to a 4KB page of $0000 - $7FFF,
+/// so that it can be read without calling `read()`.
+/// @param page The page, from 0 ($0000 - $0FFF) to 7 ($7000 - $7FFF).
+/// @return The data, or `nullptr` if it must be read through `read()`.
+auto MBC1Cartridge::rom_page(const unsigned int page) noexcept -> const uint8_t*
+{
+    if (page < 0x4)
+    {
+        return data_page(page * 0x1000);
+    }
+    return data_page(((page - 0x4) * 0x1000) + (rom_bank.byte * 0x4000));
+}
+
+/// @brief Saves or loads the state of the memory bank controller and the
+/// cartridge RAM.
+/// @param state The save state serializer.
+auto MBC1Cartridge::serialize(StateSerializer& state) noexcept -> void
+{
+    ram.serialize(state);
+    state.field(rom_bank);
+    state.field(ram_enabled);
+    state.field(ram_bank);
+    state.field(banking_mode);
+}
+
+/// @brief Returns a copy of the cartridge, for a forked system. The ROM image
+/// is shared, as is the cartridge RAM until either copy writes to it.
+/// @return The copy.
+auto MBC1Cartridge::clone() const -> std::shared_ptr<Cartridge>
+{
+    return std::make_shared<MBC1Cartridge>(*this);
+}
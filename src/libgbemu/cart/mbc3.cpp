@@ -14,11 +14,13 @@
 
 // Required for the `GameBoy::MBC3` class.
 #include "mbc3.h"
+#include "../include/state.h"
 
 using namespace GameBoy;
 
-MBC3Cartridge::MBC3Cartridge(const std::vector<uint8_t>& data) noexcept :
-Cartridge(data)
+MBC3Cartridge::MBC3Cartridge
+(const std::shared_ptr<const RomImage>& rom) noexcept :
+Cartridge(rom, CartKind::MBC3)
 { }
 
 /// @brief Returns a byte from the cartridge.
@@ -46,6 +48,11 @@ auto MBC3Cartridge::read(const uint16_t address) noexcept -> uint8_t
         // memory space is used to access an 8KB external RAM bank, or a single
         // RTC register.
         case 0xA ... 0xB:
+            // The RTC registers aren't emulated.
+            if (ram_bank >= RAM_BANKS)
+            {
+                return 0xFF;
+            }
             return ram[(address - 0xA000) + (ram_bank * 0x2000)];
 
         default:
@@ -113,7 +120,49 @@ auto MBC3Cartridge::write(const uint16_t address,
         // memory space is used to access an 8KB external RAM bank, or a single
         // RTC register.
         case 0xA ... 0xB:
-            ram[(address - 0xA000) + (ram_bank * 0x2000)] = value;
+            if (ram_bank >= RAM_BANKS)
+            {
+                return;
+            }
+            ram.write((address - 0xA000) + (ram_bank * 0x2000), value);
             return;
     }
-}
\ No newline at end of file
+}
+
+/// @brief Returns the ROM bank currently mapped to $4000 - $7FFF.
+/// @return The ROM bank.
+auto MBC3Cartridge::current_rom_bank() noexcept -> unsigned int
+{
+    return rom_bank;
+}
+
+/// @brief Returns the ROM data currently mapped to a 4KB page of $0000 - $7FFF,
+/// so that it can be read without calling `read()`.
+/// @param page The page, from 0 ($0000 - $0FFF) to 7 ($7000 - $7FFF).
+/// @return The data, or `nullptr` if it must be read through `read()`.
+auto MBC3Cartridge::rom_page(const unsigned int page) noexcept -> const uint8_t*
+{
+    if (page < 0x4)
+    {
+        return data_page(page * 0x1000);
+    }
+    return data_page(((page - 0x4) * 0x1000) + (rom_bank * 0x4000));
+}
+
+/// @brief Saves or loads the state of the memory bank controller and the
+/// cartridge RAM.
+/// @param state The save state serializer.
+auto MBC3Cartridge::serialize(StateSerializer& state) noexcept -> void
+{
+    ram.serialize(state);
+    state.field(rom_bank);
+    state.field(ram_bank);
+}
+
+/// @brief Returns a copy of the cartridge, for a forked system. The ROM image
+/// is shared, as is the cartridge RAM until either copy writes to it.
+/// @return The copy.
+auto MBC3Cartridge::clone() const -> std::shared_ptr<Cartridge>
+{
+    return std::make_shared<MBC3Cartridge>(*this);
+}
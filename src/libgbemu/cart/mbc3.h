@@ -22,8 +22,8 @@
 // Source: https://gcc.gnu.org/onlinedocs/cpp/Pragmas.html
 #pragma once
 
-#include <array>
 #include "../include/cart.h"
+#include "../include/cow_memory.h"
 
 namespace GameBoy
 {
@@ -31,7 +31,8 @@ namespace GameBoy
     class MBC3Cartridge final : public Cartridge
     {
     public:
-        explicit MBC3Cartridge(const std::vector<uint8_t>& data) noexcept;
+        explicit MBC3Cartridge
+        (const std::shared_ptr<const RomImage>& rom) noexcept;
 
         /// @brief Returns a byte from the cartridge.
         /// @param address The memory address to read from.
@@ -44,9 +45,34 @@ namespace GameBoy
         auto write(const uint16_t address,
                    const uint8_t value) noexcept -> void;
 
+        /// @brief Returns the ROM bank currently mapped to $4000 - $7FFF.
+        /// @return The ROM bank.
+        auto current_rom_bank() noexcept -> unsigned int;
+
+        /// @brief Returns the ROM data currently mapped to a 4KB page of
+        /// $0000 - $7FFF, so that it can be read without calling `read()`.
+        /// @param page The page, from 0 ($0000 - $0FFF) to 7 ($7000 - $7FFF).
+        /// @return The data, or `nullptr` if it must be read through `read()`.
+        auto rom_page(const unsigned int page) noexcept -> const uint8_t*;
+
+        /// @brief Saves or loads the state of the memory bank controller and
+        /// the cartridge RAM.
+        /// @param state The save state serializer.
+        auto serialize(StateSerializer& state) noexcept -> void;
+
+        /// @brief Returns a copy of the cartridge, for a forked system. The
+        /// ROM image is shared, as is the cartridge RAM until either copy
+        /// writes to it.
+        /// @return The copy.
+        auto clone() const -> std::shared_ptr<Cartridge>;
+
     private:
         /// @brief 32KB RAM
-        std::array<uint8_t, 32768> ram;
+        CowMemory<32768> ram;
+
+        /// @brief The number of 8KB banks in `ram`. Selecting any other bank
+        /// leaves $A000 - $BFFF unmapped.
+        static constexpr unsigned int RAM_BANKS{ 4 };
 
         /// @brief The current ROM bank.
         uint8_t rom_bank;
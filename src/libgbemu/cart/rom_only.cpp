@@ -17,8 +17,9 @@
 
 using namespace GameBoy;
 
-ROMOnlyCartridge::ROMOnlyCartridge(const std::vector<uint8_t>& data) noexcept :
-Cartridge(data)
+ROMOnlyCartridge::ROMOnlyCartridge
+(const std::shared_ptr<const RomImage>& rom) noexcept :
+Cartridge(rom, CartKind::ROMOnly)
 { }
 
 /// @brief Returns a byte from the cartridge.
@@ -40,4 +41,37 @@ auto ROMOnlyCartridge::write(const uint16_t address,
                              const uint8_t value) noexcept -> void
 {
     //__debugbreak();
-}
\ No newline at end of file
+}
+
+/// @brief Returns the ROM bank currently mapped to $4000 - $7FFF.
+/// @return The ROM bank.
+auto ROMOnlyCartridge::current_rom_bank() noexcept -> unsigned int
+{
+    return 1;
+}
+
+/// @brief Returns the ROM data currently mapped to a 4KB page of $0000 - $7FFF,
+/// so that it can be read without calling `read()`.
+/// @param page The page, from 0 ($0000 - $0FFF) to 7 ($7000 - $7FFF).
+/// @return The data, or `nullptr` if it must be read through `read()`.
+auto ROMOnlyCartridge::rom_page(const unsigned int page) noexcept
+-> const uint8_t*
+{
+    return data_page(page * 0x1000);
+}
+
+/// @brief Saves or loads the state of the memory bank controller and the
+/// cartridge RAM.
+///
+/// There is neither here, so the state is empty.
+/// @param state The save state serializer.
+auto ROMOnlyCartridge::serialize(StateSerializer&) noexcept -> void
+{ }
+
+/// @brief Returns a copy of the cartridge, for a forked system. The ROM image
+/// is shared.
+/// @return The copy.
+auto ROMOnlyCartridge::clone() const -> std::shared_ptr<Cartridge>
+{
+    return std::make_shared<ROMOnlyCartridge>(*this);
+}
@@ -12,16 +12,38 @@
 // OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
 // CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
+#include <algorithm>
+#include <functional>
 #include "bus.h"
 #include "cpu.h"
+#include "state.h"
+
+#ifdef GBEMU_ALU_TABLES
+#include "alu_tables.h"
+#endif
+
+#ifdef GBEMU_JIT
+#include "../jit/recompiler.h"
+#endif
 
 using namespace GameBoy;
-using namespace std::placeholders;
+
+/// @brief The number of times a block must be entered before it is
+/// recompiled.
+constexpr unsigned int JIT_THRESHOLD{ 16 };
+
+/// @brief The maximum number of T-cycles skipped at once while halted (one
+/// frame), so that the CPU returns control regularly even if no event is
+/// pending at all.
+constexpr unsigned int MAX_HALT_CYCLES{ 70224 };
 
 /// @brief Initializes the CPU.
 /// @param bus The current system bus instance.
-CPU::CPU(SystemBus& bus) noexcept : m_bus(bus)
+CPU::CPU(SystemBus& bus) noexcept : idle_loops(bus),
+                                     cache(bus),
+                                     m_bus(bus)
 {
+    mode = ExecutionMode::Interpreter;
     reset();
 }
 
@@ -30,6 +52,13 @@ CPU::CPU(SystemBus& bus) noexcept : m_bus(bus)
 /// @return The byte from memory.
 auto CPU::read_next_byte() noexcept -> uint8_t
 {
+    if (predecoded)
+    {
+        const uint8_t data{ static_cast<uint8_t>(operand & 0x00FF) };
+        operand >>= 8;
+
+        return data;
+    }
     return m_bus.read(reg.pc++);
 }
 
@@ -62,6 +91,87 @@ inline auto CPU::interrupt_check(const Interrupt intr,
     }
 }
 
+/// @brief Returns the value of the Flag (F) register.
+///
+/// With lazy flag evaluation (`GBEMU_LAZY_FLAGS`), `reg.f` may be out of date,
+/// so this must be used instead of reading it directly.
+/// @return The value of the Flag (F) register.
+auto CPU::flags() const noexcept -> uint8_t
+{
+#ifdef GBEMU_LAZY_FLAGS
+    const auto& pending{ pending_flags };
+
+    const unsigned int zero{ (pending.result & 0xFF) ? 0u : 0x80u };
+
+    const unsigned int half_carry
+    {
+        (pending.lhs ^ pending.rhs ^ pending.result) & 0x10
+    };
+
+    // Every other flag is computed as a 0 or 1 shifted into its bit position.
+    switch (pending.operation)
+    {
+        case FlagOperation::None:
+            break;
+
+        case FlagOperation::Add:
+            return zero | (half_carry << 1) | ((pending.result > 0xFF) << 4);
+
+        case FlagOperation::Subtract:
+            // A borrow wraps the result around, setting bit 8.
+            return zero | FlagBit::Subtract | (half_carry << 1) |
+                   ((pending.result & 0x100) >> 4);
+
+        case FlagOperation::Increment:
+            return zero | (((pending.result & 0x0F) == 0x00) << 5) |
+                   (pending.rhs << 4);
+
+        case FlagOperation::Decrement:
+            return zero | FlagBit::Subtract |
+                   (((pending.result & 0x0F) == 0x0F) << 5) |
+                   (pending.rhs << 4);
+    }
+#endif
+    return reg.f;
+}
+
+/// @brief Brings `reg.f` up to date with any flags still pending from the last
+/// arithmetic instruction.
+auto CPU::sync_flags() noexcept -> void
+{
+#ifdef GBEMU_LAZY_FLAGS
+    if (pending_flags.operation != FlagOperation::None)
+    {
+        reg.f = flags();
+        pending_flags.operation = FlagOperation::None;
+    }
+#endif
+}
+
+/// @brief Returns the Carry flag.
+/// @return `true` if the Carry flag is set, or `false` otherwise.
+auto CPU::carry() const noexcept -> bool
+{
+#ifdef GBEMU_LAZY_FLAGS
+    switch (pending_flags.operation)
+    {
+        case FlagOperation::None:
+            break;
+
+        case FlagOperation::Add:
+            return pending_flags.result > 0xFF;
+
+        case FlagOperation::Subtract:
+            return pending_flags.result & 0x100;
+
+        case FlagOperation::Increment:
+        case FlagOperation::Decrement:
+            return pending_flags.rhs;
+    }
+#endif
+    return reg.f & FlagBit::Carry;
+}
+
 /// @brief Conditionally sets or resets a bit in the Flag (F) register.
 /// @param bit The bit in question.
 /// @param condition_met If the result of an expression returns `true`,
@@ -69,6 +179,8 @@ inline auto CPU::interrupt_check(const Interrupt intr,
 auto CPU::update_flag_bit(const enum FlagBit bit,
                           const bool condition_met) noexcept -> void
 {
+    sync_flags();
+
     if (condition_met)
     {
         reg.f |= bit;
@@ -123,7 +235,8 @@ auto CPU::set_carry_flag(const bool condition) noexcept -> void
 /// calls an ALU function and stores the result of the ALU operation back into
 /// memory using register pair HL as a memory address.
 /// @param f The function to call.
-auto CPU::rw_hl(const ALUFunc& f) noexcept -> void
+template<class Function>
+auto CPU::rw_hl(const Function f) noexcept -> void
 {
     m_bus.write(reg.hl, f(m_bus.read(reg.hl)));
 }
@@ -145,6 +258,8 @@ auto CPU::bit_op(const Operator op,
 {
     reg.a = op(reg.a, n);
     reg.f = (reg.a == 0) ? flags_if_zero : flags_if_nonzero;
+
+    pending_flags.operation = FlagOperation::None;
 }
 
 /// @brief Handles the INC instruction.
@@ -152,9 +267,21 @@ auto CPU::bit_op(const Operator op,
 /// @return The incremented value.
 auto CPU::inc(uint8_t r) noexcept -> uint8_t
 {
+#if defined(GBEMU_ALU_TABLES)
+    const uint16_t af{ inc_table[r] };
+
+    reg.f = (af & 0xFF) | (flags() & FlagBit::Carry);
+    pending_flags.operation = FlagOperation::None;
+
+    r = af >> 8;
+#elif defined(GBEMU_LAZY_FLAGS)
+    pending_flags = { FlagOperation::Increment, r, carry(), r + 1u };
+    ++r;
+#else
     set_subtract_flag(false);
     set_half_carry_flag((r & 0x0F) == 0x0F);
     set_zero_flag(++r);
+#endif
 
     return r;
 }
@@ -164,9 +291,21 @@ auto CPU::inc(uint8_t r) noexcept -> uint8_t
 /// @return The decremented value.
 auto CPU::dec(uint8_t r) noexcept -> uint8_t
 {
+#if defined(GBEMU_ALU_TABLES)
+    const uint16_t af{ dec_table[r] };
+
+    reg.f = (af & 0xFF) | (flags() & FlagBit::Carry);
+    pending_flags.operation = FlagOperation::None;
+
+    r = af >> 8;
+#elif defined(GBEMU_LAZY_FLAGS)
+    pending_flags = { FlagOperation::Decrement, r, carry(), r - 1u };
+    --r;
+#else
     set_subtract_flag(true);
     set_half_carry_flag((r & 0x0F) == 0);
     set_zero_flag(--r);
+#endif
 
     return r;
 }
@@ -207,22 +346,33 @@ auto CPU::jr(const bool condition_met) -> void
 /// `ALUFlag::WithCarry`: ADC instruction
 auto CPU::add(const uint8_t addend, const ALUFlag flag) noexcept -> void
 {
-    set_subtract_flag(false);
+#ifdef GBEMU_ALU_TABLES
+    const bool carry_in{ (flag == ALUFlag::WithCarry) && carry() };
 
+    reg.af = add_table[(carry_in << 16) | (reg.a << 8) | addend];
+    pending_flags.operation = FlagOperation::None;
+#else
     unsigned int result = reg.a + addend;
 
     if (flag == ALUFlag::WithCarry)
     {
-        result += (reg.f & FlagBit::Carry) != 0;
+        result += carry();
     }
 
     const uint8_t sum{ static_cast<uint8_t>(result) };
 
+#ifdef GBEMU_LAZY_FLAGS
+    pending_flags = { FlagOperation::Add, reg.a, addend, result };
+#else
+    set_subtract_flag(false);
+
     set_zero_flag(sum);
     set_half_carry_flag((reg.a ^ addend ^ result) & 0x10);
     set_carry_flag(result > 0xFF);
+#endif
 
     reg.a = sum;
+#endif
 }
 
 /// @brief Handles a subtraction operation.
@@ -234,25 +384,46 @@ auto CPU::add(const uint8_t addend, const ALUFlag flag) noexcept -> void
 /// `ALUFlag::DiscardResult`: CP instruction
 auto CPU::sub(const uint8_t subtrahend, const ALUFlag flag) noexcept -> void
 {
-    set_subtract_flag(true);
+#ifdef GBEMU_ALU_TABLES
+    const bool carry_in{ (flag == ALUFlag::WithCarry) && carry() };
+    const uint16_t af{ sub_table[(carry_in << 16) | (reg.a << 8) | subtrahend] };
 
+    if (flag == ALUFlag::DiscardResult)
+    {
+        reg.f = af & 0xFF;
+    }
+    else
+    {
+        reg.af = af;
+    }
+    pending_flags.operation = FlagOperation::None;
+#else
     int result{ reg.a - subtrahend };
 
     if (flag == ALUFlag::WithCarry)
     {
-        result -= (reg.f & FlagBit::Carry) != 0;
+        result -= carry();
     }
 
     const uint8_t diff{ static_cast<uint8_t>(result) };
 
+#ifdef GBEMU_LAZY_FLAGS
+    pending_flags = { FlagOperation::Subtract,
+                      reg.a,
+                      subtrahend,
+                      static_cast<unsigned int>(result) };
+#else
+    set_subtract_flag(true);
     set_zero_flag(diff);
     set_half_carry_flag((reg.a ^ subtrahend ^ result) & 0x10);
     set_carry_flag(result < 0);
+#endif
 
     if (flag != ALUFlag::DiscardResult)
     {
         reg.a = diff;
     }
+#endif
 }
 
 /// @brief Handles a return from subroutine.
@@ -428,7 +599,7 @@ auto CPU::rl(uint8_t n, const ALUFlag flag) noexcept -> uint8_t
     set_subtract_flag(false);
     set_half_carry_flag(false);
 
-    const bool carry{ (reg.f & FlagBit::Carry) != 0 };
+    const bool carry{ this->carry() };
 
     set_carry_flag(n & 0x80);
 
@@ -458,7 +629,7 @@ auto CPU::rr(uint8_t n, const ALUFlag flag) noexcept -> uint8_t
     set_half_carry_flag(false);
 
     const bool old_carry{ (n & 1) != 0 };
-    const bool carry{ (reg.f & FlagBit::Carry) != 0 };
+    const bool carry{ this->carry() };
 
     n = (n >> 1) | (carry << 7);
 
@@ -513,7 +684,9 @@ auto CPU::sra(uint8_t n) noexcept -> uint8_t
 auto CPU::swap(uint8_t n) noexcept -> uint8_t
 {
     n = ((n & 0x0F) << 4) | (n >> 4);
+
     reg.f = (n == 0) ? 0x80 : 0x00;
+    pending_flags.operation = FlagOperation::None;
 
     return n;
 }
@@ -536,6 +709,90 @@ auto CPU::srl(uint8_t n) noexcept -> uint8_t
     return n;
 }
 
+/// @brief Handles the DAA instruction.
+///
+/// XXX: NOT MY CODE. Taken from https://bit.ly/3j24lzB under the terms of the
+/// MIT license.
+auto CPU::daa() noexcept -> void
+{
+#ifdef GBEMU_ALU_TABLES
+    reg.af = daa_table[(reg.a << 4) | (flags() >> 4)];
+    pending_flags.operation = FlagOperation::None;
+#else
+    const uint8_t flags{ this->flags() };
+    uint8_t adjust{ 0 };
+
+    // See if we had a carry/borrow for the low nibble in the last
+    // operation.
+    if (flags & FlagBit::HalfCarry)
+    {
+        // Yes, we have to adjust it.
+        adjust |= 0x06;
+    }
+
+    // See if we had a carry/borrow for the high nibble in the last
+    // operation.
+    if (flags & FlagBit::Carry)
+    {
+        // Yes, we have to adjust it.
+        adjust |= 0x60;
+    }
+
+    if (flags & FlagBit::Subtract)
+    {
+        // If the operation was a subtraction we're done since we
+        // can never end up in the A-F range by substracting
+        // without generating a (half)carry.
+        reg.a -= adjust;
+    }
+    else
+    {
+        // Additions are a bit more tricky because we might have
+        // to adjust even if we haven't overflowed (and no carry
+        // is present). For instance: 0x8 + 0x4 -> 0xc.
+        if ((reg.a & 0x0F) > 0x09)
+        {
+            adjust |= 0x06;
+        }
+
+        if (reg.a > 0x99)
+        {
+            adjust |= 0x60;
+        }
+        reg.a += adjust;
+    }
+
+    set_zero_flag(reg.a);
+    set_carry_flag(adjust & 0x60);
+    set_half_carry_flag(false);
+#endif
+}
+
+/// @brief Handles the CPL instruction.
+auto CPU::cpl() noexcept -> void
+{
+    reg.a = ~reg.a;
+
+    set_subtract_flag(true);
+    set_half_carry_flag(true);
+}
+
+/// @brief Handles the SCF instruction.
+auto CPU::scf() noexcept -> void
+{
+    set_carry_flag(true);
+    set_subtract_flag(false);
+    set_half_carry_flag(false);
+}
+
+/// @brief Handles the CCF instruction.
+auto CPU::ccf() noexcept -> void
+{
+    set_subtract_flag(false);
+    set_half_carry_flag(false);
+    set_carry_flag(!carry());
+}
+
 /// @brief Handles the BIT instruction.
 /// @param b The bit to test.
 /// @param n The value to test `b` against.
@@ -558,6 +815,348 @@ auto CPU::bit_hl(const Operator op,
     m_bus.write(reg.hl, op(m_bus.read(reg.hl), bit));
 }
 
+/// @brief Returns the value of an 8-bit operand.
+/// @tparam Index The operand as encoded in an opcode:
+/// B, C, D, E, H, L, (HL), A.
+/// @return The value of the operand.
+template<unsigned int Index>
+auto CPU::get_r8() noexcept -> uint8_t
+{
+    if constexpr (Index == 0) { return reg.b;              }
+    if constexpr (Index == 1) { return reg.c;              }
+    if constexpr (Index == 2) { return reg.d;              }
+    if constexpr (Index == 3) { return reg.e;              }
+    if constexpr (Index == 4) { return reg.h;              }
+    if constexpr (Index == 5) { return reg.l;              }
+    if constexpr (Index == 6) { return m_bus.read(reg.hl); }
+    if constexpr (Index == 7) { return reg.a;              }
+}
+
+/// @brief Stores a value into an 8-bit operand.
+/// @tparam Index The operand as encoded in an opcode:
+/// B, C, D, E, H, L, (HL), A.
+/// @param data The value to store.
+template<unsigned int Index>
+auto CPU::set_r8(const uint8_t data) noexcept -> void
+{
+    if constexpr (Index == 0) { reg.b = data;              }
+    if constexpr (Index == 1) { reg.c = data;              }
+    if constexpr (Index == 2) { reg.d = data;              }
+    if constexpr (Index == 3) { reg.e = data;              }
+    if constexpr (Index == 4) { reg.h = data;              }
+    if constexpr (Index == 5) { reg.l = data;              }
+    if constexpr (Index == 6) { m_bus.write(reg.hl, data); }
+    if constexpr (Index == 7) { reg.a = data;              }
+}
+
+/// @brief Returns a register pair.
+/// @tparam Index The register pair as encoded in an opcode: BC, DE, HL, SP.
+/// @return The register pair.
+template<unsigned int Index>
+auto CPU::r16() noexcept -> uint16_t&
+{
+    if constexpr (Index == 0) { return reg.bc; }
+    if constexpr (Index == 1) { return reg.de; }
+    if constexpr (Index == 2) { return reg.hl; }
+    if constexpr (Index == 3) { return reg.sp; }
+}
+
+/// @brief Evaluates a branch condition.
+/// @tparam Index The condition as encoded in an opcode: NZ, Z, NC, C.
+/// @return `true` if the condition is met, or `false` otherwise.
+template<unsigned int Index>
+auto CPU::condition() const noexcept -> bool
+{
+    if constexpr (Index == 0) { return !(flags() & FlagBit::Zero); }
+    if constexpr (Index == 1) { return flags() & FlagBit::Zero;    }
+    if constexpr (Index == 2) { return !carry();                   }
+    if constexpr (Index == 3) { return carry();                    }
+}
+
+/// @brief Performs an ALU operation on the Accumulator (register A).
+/// @tparam Operation The operation as encoded in an opcode:
+/// ADD, ADC, SUB, SBC, AND, XOR, OR, CP.
+/// @param n The operand.
+template<unsigned int Operation>
+auto CPU::alu(const uint8_t n) noexcept -> void
+{
+    if constexpr (Operation == 0) { add(n);                                        }
+    if constexpr (Operation == 1) { add(n, ALUFlag::WithCarry);                    }
+    if constexpr (Operation == 2) { sub(n);                                        }
+    if constexpr (Operation == 3) { sub(n, ALUFlag::WithCarry);                    }
+    if constexpr (Operation == 4) { bit_op(std::bit_and<uint8_t>(), n, 0xA0, 0x20); }
+    if constexpr (Operation == 5) { bit_op(std::bit_xor<uint8_t>(), n, 0x80, 0x00); }
+    if constexpr (Operation == 6) { bit_op(std::bit_or<uint8_t>(),  n, 0x80, 0x00); }
+    if constexpr (Operation == 7) { sub(n, ALUFlag::DiscardResult);                }
+}
+
+/// @brief Performs a CB-prefixed rotate or shift operation.
+/// @tparam Operation The operation as encoded in an opcode:
+/// RLC, RRC, RL, RR, SLA, SRA, SWAP, SRL.
+/// @param n The value to rotate or shift.
+/// @return The rotated or shifted value.
+template<unsigned int Operation>
+auto CPU::rotate(const uint8_t n) noexcept -> uint8_t
+{
+    if constexpr (Operation == 0) { return rlc(n);  }
+    if constexpr (Operation == 1) { return rrc(n);  }
+    if constexpr (Operation == 2) { return rl(n);   }
+    if constexpr (Operation == 3) { return rr(n);   }
+    if constexpr (Operation == 4) { return sla(n);  }
+    if constexpr (Operation == 5) { return sra(n);  }
+    if constexpr (Operation == 6) { return swap(n); }
+    if constexpr (Operation == 7) { return srl(n);  }
+}
+
+/// @brief Executes an instruction decoded at compile time.
+///
+/// The opcode is split into the fields x (bits 7-6), y (bits 5-3) and z
+/// (bits 2-0), where y is further split into p (bits 5-4) and q (bit 3). The
+/// regular blocks of the instruction set then reduce to a handful of cases.
+/// @tparam Opcode The opcode of the instruction.
+template<uint8_t Opcode>
+auto CPU::execute() noexcept -> void
+{
+    constexpr unsigned int x{ Opcode >> 6 };
+    constexpr unsigned int y{ (Opcode >> 3) & 7 };
+    constexpr unsigned int z{ Opcode & 7 };
+    constexpr unsigned int p{ y >> 1 };
+    constexpr unsigned int q{ y & 1 };
+
+    if constexpr (Opcode == 0x76)
+    {
+        halted = true; // HALT
+    }
+    else if constexpr (x == 1)
+    {
+        set_r8<y>(get_r8<z>()); // LD r, r
+    }
+    else if constexpr (x == 2)
+    {
+        alu<y>(get_r8<z>()); // ALU A, r
+    }
+    else if constexpr (x == 0)
+    {
+        if constexpr (z == 0)
+        {
+            // NOP and STOP are both treated as no-ops.
+            if constexpr (y == 1)
+            {
+                // LD ($imm16), SP
+                const uint16_t address{ read_next_word() };
+
+                m_bus.write(address,     reg.sp & 0x00FF);
+                m_bus.write(address + 1, reg.sp >> 8);
+            }
+            else if constexpr (y == 3)
+            {
+                jr(true); // JR $branch
+            }
+            else if constexpr (y >= 4)
+            {
+                jr(condition<y - 4>()); // JR cc, $branch
+            }
+        }
+        else if constexpr (z == 1)
+        {
+            if constexpr (q == 0)
+            {
+                r16<p>() = read_next_word(); // LD rr, $imm16
+            }
+            else
+            {
+                add_hl(r16<p>()); // ADD HL, rr
+            }
+        }
+        else if constexpr (z == 2)
+        {
+            if constexpr (Opcode == 0x02) { m_bus.write(reg.bc, reg.a);   } // LD (BC), A
+            if constexpr (Opcode == 0x12) { m_bus.write(reg.de, reg.a);   } // LD (DE), A
+            if constexpr (Opcode == 0x22) { m_bus.write(reg.hl++, reg.a); } // LD (HL+), A
+            if constexpr (Opcode == 0x32) { m_bus.write(reg.hl--, reg.a); } // LD (HL-), A
+            if constexpr (Opcode == 0x0A) { reg.a = m_bus.read(reg.bc);   } // LD A, (BC)
+            if constexpr (Opcode == 0x1A) { reg.a = m_bus.read(reg.de);   } // LD A, (DE)
+            if constexpr (Opcode == 0x2A) { reg.a = m_bus.read(reg.hl++); } // LD A, (HL+)
+            if constexpr (Opcode == 0x3A) { reg.a = m_bus.read(reg.hl--); } // LD A, (HL-)
+        }
+        else if constexpr (z == 3)
+        {
+            if constexpr (q == 0)
+            {
+                r16<p>()++; // INC rr
+            }
+            else
+            {
+                r16<p>()--; // DEC rr
+            }
+            m_bus.step();
+        }
+        else if constexpr (z == 4)
+        {
+            set_r8<y>(inc(get_r8<y>())); // INC r
+        }
+        else if constexpr (z == 5)
+        {
+            set_r8<y>(dec(get_r8<y>())); // DEC r
+        }
+        else if constexpr (z == 6)
+        {
+            set_r8<y>(read_next_byte()); // LD r, $imm8
+        }
+        else
+        {
+            if constexpr (y == 0) { reg.a = rlc(reg.a, ALUFlag::ClearZeroFlag); } // RLCA
+            if constexpr (y == 1) { reg.a = rrc(reg.a, ALUFlag::ClearZeroFlag); } // RRCA
+            if constexpr (y == 2) { reg.a = rl(reg.a, ALUFlag::ClearZeroFlag);  } // RLA
+            if constexpr (y == 3) { reg.a = rr(reg.a, ALUFlag::ClearZeroFlag);  } // RRA
+            if constexpr (y == 4) { daa();                                      } // DAA
+            if constexpr (y == 5) { cpl();                                      } // CPL
+            if constexpr (y == 6) { scf();                                      } // SCF
+            if constexpr (y == 7) { ccf();                                      } // CCF
+        }
+    }
+    else
+    {
+        if constexpr (z == 0)
+        {
+            if constexpr (y < 4)
+            {
+                ret(condition<y>(), OpFlag::TrulyConditional); // RET cc
+            }
+
+            if constexpr (Opcode == 0xE0) { m_bus.write(0xFF00 + read_next_byte(), reg.a); } // LDH ($imm8), A
+            if constexpr (Opcode == 0xE8) { reg.sp = add_sp(ExtraDelay);                   } // ADD SP, $simm8
+            if constexpr (Opcode == 0xF0) { reg.a = m_bus.read(0xFF00 + read_next_byte()); } // LDH A, ($imm8)
+            if constexpr (Opcode == 0xF8) { reg.hl = add_sp();                             } // LD HL, SP+$simm8
+        }
+        else if constexpr (z == 1)
+        {
+            if constexpr (Opcode == 0xF1)
+            {
+                reg.af = stack_pop() & ~0x0F; // POP AF
+                pending_flags.operation = FlagOperation::None;
+            }
+            else if constexpr (q == 0)
+            {
+                r16<p>() = stack_pop(); // POP rr
+            }
+
+            if constexpr (Opcode == 0xC9) { ret(true);                   } // RET
+            if constexpr (Opcode == 0xD9) { ret(true); ime = true;       } // RETI
+            if constexpr (Opcode == 0xE9) { reg.pc = reg.hl;             } // JP (HL)
+            if constexpr (Opcode == 0xF9) { reg.sp = reg.hl; m_bus.step(); } // LD SP, HL
+        }
+        else if constexpr (z == 2)
+        {
+            if constexpr (y < 4)
+            {
+                jp(condition<y>()); // JP cc, $imm16
+            }
+
+            if constexpr (Opcode == 0xE2) { m_bus.write(0xFF00 + reg.c, reg.a);   } // LD (C), A
+            if constexpr (Opcode == 0xEA) { m_bus.write(read_next_word(), reg.a); } // LD ($imm16), A
+            if constexpr (Opcode == 0xF2) { reg.a = m_bus.read(0xFF00 + reg.c);   } // LD A, (C)
+            if constexpr (Opcode == 0xFA) { reg.a = m_bus.read(read_next_word()); } // LD A, ($imm16)
+        }
+        else if constexpr (z == 3)
+        {
+            // The remaining opcodes in this column are illegal, and are
+            // treated as no-ops.
+            if constexpr (Opcode == 0xC3) { jp(true);                       } // JP $imm16
+            if constexpr (Opcode == 0xCB) { dispatch_cb(read_next_byte()); } // CB-prefixed instruction
+            if constexpr (Opcode == 0xF3) { ime = false;                    } // DI
+            if constexpr (Opcode == 0xFB) { ime = true;                     } // EI
+        }
+        else if constexpr (z == 4)
+        {
+            if constexpr (y < 4)
+            {
+                call(condition<y>()); // CALL cc, $imm16
+            }
+        }
+        else if constexpr (z == 5)
+        {
+            if constexpr (Opcode == 0xF5)
+            {
+                sync_flags();
+                stack_push(reg.af); // PUSH AF
+            }
+            else if constexpr (q == 0)
+            {
+                stack_push(r16<p>()); // PUSH rr
+            }
+
+            if constexpr (Opcode == 0xCD) { call(true); } // CALL $imm16
+        }
+        else if constexpr (z == 6)
+        {
+            alu<y>(read_next_byte()); // ALU A, $imm8
+        }
+        else
+        {
+            rst(y * 8); // RST vector
+        }
+    }
+}
+
+/// @brief Executes a CB-prefixed instruction decoded at compile time.
+/// @tparam Opcode The opcode following the $CB prefix.
+template<uint8_t Opcode>
+auto CPU::execute_cb() noexcept -> void
+{
+    constexpr unsigned int x{ Opcode >> 6 };
+    constexpr unsigned int y{ (Opcode >> 3) & 7 };
+    constexpr unsigned int z{ Opcode & 7 };
+
+    if constexpr (x == 0)
+    {
+        set_r8<z>(rotate<y>(get_r8<z>())); // Rotates and shifts
+    }
+    else if constexpr (x == 1)
+    {
+        bit(y, get_r8<z>()); // BIT b, r
+    }
+    else if constexpr (x == 2)
+    {
+        set_r8<z>(get_r8<z>() & ~(1 << y)); // RES b, r
+    }
+    else
+    {
+        set_r8<z>(get_r8<z>() | (1 << y)); // SET b, r
+    }
+}
+
+/// @brief Dispatch table entry for an instruction.
+/// @tparam Index $000-$0FF for instructions, or $100-$1FF for CB-prefixed
+/// instructions.
+/// @param cpu The CPU to execute the instruction on.
+template<unsigned int Index>
+auto CPU::handler(CPU& cpu) noexcept -> void
+{
+    if constexpr (Index < 0x100)
+    {
+        cpu.execute<Index>();
+    }
+    else
+    {
+        cpu.execute_cb<Index & 0xFF>();
+    }
+}
+
+/// @brief Generates the dispatch table.
+/// @return The dispatch table.
+template<std::size_t... Index>
+constexpr auto CPU::make_handlers(std::index_sequence<Index...>) noexcept
+-> std::array<Handler, sizeof...(Index)>
+{
+    return { &CPU::handler<Index>... };
+}
+
+const std::array<CPU::Handler, 512> CPU::handlers
+{
+    CPU::make_handlers(std::make_index_sequence<512>())
+};
+
 /// @brief Resets the CPU to the startup state.
 auto CPU::reset() noexcept -> void
 {
@@ -565,17 +1164,69 @@ auto CPU::reset() noexcept -> void
     reg.de = 0x00D8;
     reg.hl = 0x014D;
     reg.af = 0x01B0;
+    pending_flags = { FlagOperation::None, 0, 0, 0 };
 
     reg.sp = 0xFFFE;
     reg.pc = 0x0100;
 
     ime    = false;
     halted = false;
+
+    cache.clear();
+    block = nullptr;
+    block_index = 0;
+
+#ifdef GBEMU_JIT
+    jit = std::make_shared<Recompiler>();
+#endif
+
+    ram_code_generation = m_bus.ram_code_generation;
+    rom_generation = m_bus.rom_generation;
+
+    predecoded = false;
+    operand = 0x0000;
+
+    idle_loops.reset();
+}
+
+/// @brief Saves or loads the state of the CPU.
+///
+/// Only the architectural state is saved. Anything derived from memory, such
+/// as decoded blocks, is discarded when loading.
+/// @param state The save state serializer.
+auto CPU::serialize(StateSerializer& state) noexcept -> void
+{
+    // Pending flags are evaluated rather than saved, so that states don't
+    // depend on whether lazy flag evaluation was built in.
+    sync_flags();
+
+    state.field(reg);
+    state.field(ime);
+    state.field(halted);
+
+    if (state.loading())
+    {
+        pending_flags.operation = FlagOperation::None;
+
+        // The bus notes that memory was replaced, which discards blocks
+        // decoded from RAM the next time one is looked up.
+        block = nullptr;
+        block_index = 0;
+
+        predecoded = false;
+        operand = 0x0000;
+
+        idle_loops.forget();
+    }
 }
 
 /// @brief Executes the next instruction.
 auto CPU::step() noexcept -> void
 {
+    // Interrupts raised by events that became due during the last
+    // instruction must be visible here.
+    m_bus.sync();
+
     const uint8_t ie{ m_bus.interrupt_enable.byte };
     uint8_t& m_if{ m_bus.interrupt_flag.byte };
 
@@ -594,12 +1245,229 @@ auto CPU::step() noexcept -> void
 
     if (halted)
     {
-        m_bus.step();
+        if (ie & m_if)
+        {
+            m_bus.step();
+            return;
+        }
+
+        // Only an event can raise an interrupt while halted, so skip straight
+        // to the next one rather than stepping one m-cycle at a time.
+        m_bus.advance(halt_cycles());
         return;
     }
 
-    const uint8_t instruction{ read_next_byte() };
+    if (idle_loops.enabled)
+    {
+        m_bus.advance(idle_loops.check(*this));
+    }
 
+    if (mode != ExecutionMode::Interpreter)
+    {
+        step_cached();
+        return;
+    }
+    dispatch(read_next_byte());
+}
+
+/// @brief Returns the number of T-cycles the CPU stays halted for before the
+/// next event is dispatched.
+/// @return The number of T-cycles, rounded up to a whole m-cycle and at most
+/// `MAX_HALT_CYCLES`.
+auto CPU::halt_cycles() const noexcept -> unsigned int
+{
+    const auto cycles
+    {
+        static_cast<unsigned int>(std::min<uint64_t>
+        (m_bus.sched.until_next_event(), MAX_HALT_CYCLES))
+    };
+    return std::max(4u, (cycles + 3) & ~3u);
+}
+
+#ifdef GBEMU_JIT
+/// @brief Executes native code for the instructions starting at the current
+/// position in `block`, if there is any and no event becomes due while it
+/// runs.
+/// @return `true` if native code was executed, or `false` otherwise.
+auto CPU::step_native() noexcept -> bool
+{
+    if (block->runs.empty())
+    {
+        return false;
+    }
+
+    const auto& run{ block->runs[block_index] };
+
+    // None of the instructions touch a device, so they can only be executed
+    // all at once if no event would have been dispatched in between.
+    if (!run.code || m_bus.sched.until_next_event() < run.cycles)
+    {
+        return false;
+    }
+
+    // The native code reads and writes `reg.f` directly. None of the handlers
+    // it calls leave any flags pending.
+    sync_flags();
+
+    run.code(this, &reg);
+    m_bus.advance(run.cycles);
+
+    reg.pc = run.next_pc;
+    block_index += run.count;
+
+    return true;
+}
+
+/// @brief Recompiles `block`, starting over with an empty block cache if the
+/// code buffer is full.
+auto CPU::recompile() noexcept -> void
+{
+    if (jit->compile(*block))
+    {
+        return;
+    }
+
+    // Native code can't be discarded while blocks still refer to it.
+    cache.clear();
+    jit->clear();
+
+    block = cache.find(reg.pc);
+
+    // Nothing fits in an empty buffer either, so give up on recompiling.
+    if (!jit->compile(*block))
+    {
+        jit.reset();
+    }
+}
+#else
+/// @brief Executes native code for the instructions starting at the current
+/// position in `block`, if there is any and no event becomes due while it
+/// runs.
+/// @return `true` if native code was executed, or `false` otherwise.
+auto CPU::step_native() noexcept -> bool
+{
+    return false;
+}
+
+/// @brief Recompiles `block`, starting over with an empty block cache if the
+/// code buffer is full.
+auto CPU::recompile() noexcept -> void
+{ }
+#endif
+
+/// @brief Executes the next instruction from the block cache, falling back to
+/// the interpreter if it can't be cached.
+auto CPU::step_cached() noexcept -> void
+{
+    // Code was written over, so any block decoded from RAM may be stale.
+    if (ram_code_generation != m_bus.ram_code_generation)
+    {
+        cache.invalidate_ram();
+        ram_code_generation = m_bus.ram_code_generation;
+        block = nullptr;
+    }
+
+    // A different bank may be mapped now, so the rest of the current block
+    // may not be what's in memory anymore. The blocks themselves are still
+    // valid, as they are keyed on the bank.
+    if (rom_generation != m_bus.rom_generation)
+    {
+        rom_generation = m_bus.rom_generation;
+        block = nullptr;
+    }
+
+    if (!block                                      ||
+        block_index == block->instructions.size()  ||
+        block->instructions[block_index].pc != reg.pc)
+    {
+        block = cache.find(reg.pc);
+        block_index = 0;
+
+        if (!block)
+        {
+            dispatch(read_next_byte());
+            return;
+        }
+
+        if (mode == ExecutionMode::Recompiler && jit && block->runs.empty() &&
+            ++block->executions >= JIT_THRESHOLD)
+        {
+            recompile();
+        }
+    }
+
+    if (mode == ExecutionMode::Recompiler && step_native())
+    {
+        return;
+    }
+
+    const auto& instruction{ block->instructions[block_index++] };
+
+    // Fetching the instruction never touches a device, so the cycles taken
+    // by it can be accounted for all at once.
+    m_bus.advance(instruction.cycles);
+
+    reg.pc += instruction.length;
+
+    predecoded = true;
+    operand = instruction.operand;
+
+    handlers[instruction.handler](*this);
+
+    predecoded = false;
+}
+
+#ifdef GBEMU_CPU_DISPATCH_GOTO
+// Expands `M` once for every opcode, $00-$FF.
+#define GBEMU_OPCODE_ROW(M, hi)                                       \
+    M(0x##hi##0) M(0x##hi##1) M(0x##hi##2) M(0x##hi##3)               \
+    M(0x##hi##4) M(0x##hi##5) M(0x##hi##6) M(0x##hi##7)               \
+    M(0x##hi##8) M(0x##hi##9) M(0x##hi##A) M(0x##hi##B)               \
+    M(0x##hi##C) M(0x##hi##D) M(0x##hi##E) M(0x##hi##F)
+
+#define GBEMU_OPCODES(M)                                              \
+    GBEMU_OPCODE_ROW(M, 0) GBEMU_OPCODE_ROW(M, 1) GBEMU_OPCODE_ROW(M, 2) \
+    GBEMU_OPCODE_ROW(M, 3) GBEMU_OPCODE_ROW(M, 4) GBEMU_OPCODE_ROW(M, 5) \
+    GBEMU_OPCODE_ROW(M, 6) GBEMU_OPCODE_ROW(M, 7) GBEMU_OPCODE_ROW(M, 8) \
+    GBEMU_OPCODE_ROW(M, 9) GBEMU_OPCODE_ROW(M, A) GBEMU_OPCODE_ROW(M, B) \
+    GBEMU_OPCODE_ROW(M, C) GBEMU_OPCODE_ROW(M, D) GBEMU_OPCODE_ROW(M, E) \
+    GBEMU_OPCODE_ROW(M, F)
+
+#define GBEMU_LABEL_ADDRESS(opcode) &&op_##opcode,
+#define GBEMU_LABEL(opcode)         op_##opcode: execute<opcode>(); return;
+
+#define GBEMU_CB_LABEL_ADDRESS(opcode) &&cb_##opcode,
+#define GBEMU_CB_LABEL(opcode)         cb_##opcode: execute_cb<opcode>(); return;
+#endif
+
+/// @brief Executes a CB-prefixed instruction using the dispatch backend
+/// selected at build time.
+/// @param instruction The opcode following the $CB prefix.
+auto CPU::dispatch_cb(const uint8_t instruction) noexcept -> void
+{
+#ifdef GBEMU_CPU_DISPATCH_GOTO
+    static void* const labels[256] = { GBEMU_OPCODES(GBEMU_CB_LABEL_ADDRESS) };
+
+    goto *labels[instruction];
+    GBEMU_OPCODES(GBEMU_CB_LABEL)
+#else
+    handlers[0x100 | instruction](*this);
+#endif
+}
+
+/// @brief Executes an instruction using the dispatch backend selected at build
+/// time.
+/// @param instruction The opcode of the instruction to execute.
+auto CPU::dispatch(const uint8_t instruction) noexcept -> void
+{
+#if defined(GBEMU_CPU_DISPATCH_TABLE)
+    handlers[instruction](*this);
+#elif defined(GBEMU_CPU_DISPATCH_GOTO)
+    static void* const labels[256] = { GBEMU_OPCODES(GBEMU_LABEL_ADDRESS) };
+
+    goto *labels[instruction];
+    GBEMU_OPCODES(GBEMU_LABEL)
+#else
     switch (instruction)
     {
         case 0x00:                                             return; // NOP
@@ -644,7 +1512,7 @@ auto CPU::step() noexcept -> void
         case 0x1D: reg.e = dec(reg.e);                         return; // DEC E
         case 0x1E: reg.e = read_next_byte();                   return; // LD E, $imm8
         case 0x1F: reg.a = rr(reg.a, ALUFlag::ClearZeroFlag);  return; // RRA
-        case 0x20: jr(!(reg.f & FlagBit::Zero));               return; // JR NZ, $branch
+        case 0x20: jr(!(flags() & FlagBit::Zero));             return; // JR NZ, $branch
         case 0x21: reg.hl = read_next_word();                  return; // LD HL, $imm16
         case 0x22: m_bus.write(reg.hl++, reg.a);               return; // LD (HL+), A
         case 0x23: reg.hl++; m_bus.step();                     return; // INC HL
@@ -652,62 +1520,8 @@ auto CPU::step() noexcept -> void
         case 0x25: reg.h = dec(reg.h);                         return; // DEC H
         case 0x26: reg.h = read_next_byte();                   return; // LD H, $imm8
 
-        // DAA
-        //
-        // XXX: NOT MY CODE. Taken from https://bit.ly/3j24lzB under the terms
-        // of the MIT license.
-        case 0x27:
-        {
-            uint8_t adjust{ 0 };
-
-            // See if we had a carry/borrow for the low nibble in the last
-            // operation.
-            if (reg.f & FlagBit::HalfCarry)
-            {
-                // Yes, we have to adjust it.
-                adjust |= 0x06;
-            }
-
-            // See if we had a carry/borrow for the high nibble in the last
-            // operation.
-            if (reg.f & FlagBit::Carry)
-            {
-                // Yes, we have to adjust it.
-                adjust |= 0x60;
-            }
-
-            if (reg.f & FlagBit::Subtract)
-            {
-                // If the operation was a subtraction we're done since we
-                // can never end up in the A-F range by substracting
-                // without generating a (half)carry.
-                reg.a -= adjust;
-            }
-            else
-            {
-                // Additions are a bit more tricky because we might have
-                // to adjust even if we haven't overflowed (and no carry
-                // is present). For instance: 0x8 + 0x4 -> 0xc.
-                if ((reg.a & 0x0F) > 0x09)
-                {
-                    adjust |= 0x06;
-                }
-
-                if (reg.a > 0x99)
-                {
-                    adjust |= 0x60;
-                }
-                reg.a += adjust;
-            }
-
-            set_zero_flag(reg.a);
-            set_carry_flag(adjust & 0x60);
-            set_half_carry_flag(false);
-
-            return;
-        }
-
-        case 0x28: jr(reg.f & FlagBit::Zero);    return; // JR Z, $branch
+        case 0x27: daa();                        return; // DAA
+        case 0x28: jr(flags() & FlagBit::Zero);  return; // JR Z, $branch
         case 0x29: add_hl(reg.hl);               return; // ADD HL, HL
         case 0x2A: reg.a = m_bus.read(reg.hl++); return; // LD A, (HL+)
         case 0x2B: reg.hl--; m_bus.step();       return; // DEC HL
@@ -715,32 +1529,19 @@ auto CPU::step() noexcept -> void
         case 0x2D: reg.l = dec(reg.l);           return; // DEC L
         case 0x2E: reg.l = read_next_byte();     return; // LD L, $imm8
 
-        // CPL
-        case 0x2F:
-            reg.a = ~reg.a;
-
-            set_subtract_flag(true);
-            set_half_carry_flag(true);
-
-            return;
+        case 0x2F: cpl();                        return; // CPL
 
-        case 0x30: jr(!(reg.f & FlagBit::Carry));         return; // JR NC, $branch
+        case 0x30: jr(!carry());                          return; // JR NC, $branch
         case 0x31: reg.sp = read_next_word();             return; // LD SP, $imm16
         case 0x32: m_bus.write(reg.hl--, reg.a);          return; // LD (HL-), A
         case 0x33: reg.sp++; m_bus.step();                return; // INC SP
-        case 0x34: rw_hl(std::bind(&CPU::inc, this, _1)); return; // INC (HL)
-        case 0x35: rw_hl(std::bind(&CPU::dec, this, _1)); return; // DEC (HL)
+        case 0x34: rw_hl([this](const uint8_t n) { return inc(n); }); return; // INC (HL)
+        case 0x35: rw_hl([this](const uint8_t n) { return dec(n); }); return; // DEC (HL)
         case 0x36: m_bus.write(reg.hl, read_next_byte()); return; // LD (HL), $imm8
 
-        // SCF
-        case 0x37:
-            set_carry_flag(true);
-            set_subtract_flag(false);
-            set_half_carry_flag(false);
+        case 0x37: scf();                                 return; // SCF
 
-            return;
-
-        case 0x38: jr(reg.f & FlagBit::Carry);   return;
+        case 0x38: jr(carry());                  return;
         case 0x39: add_hl(reg.sp);               return;
         case 0x3A: reg.a = m_bus.read(reg.hl--); return;
         case 0x3B: reg.sp--; m_bus.step();       return;
@@ -748,13 +1549,7 @@ auto CPU::step() noexcept -> void
         case 0x3D: reg.a = dec(reg.a);           return;
         case 0x3E: reg.a = read_next_byte();     return;
 
-        // CCF
-        case 0x3F:
-            set_subtract_flag(false);
-            set_half_carry_flag(false);
-            set_carry_flag(!(reg.f & FlagBit::Carry));
-
-            return;
+        case 0x3F: ccf();                        return; // CCF
 
         case 0x40:                                                                  return; // LD B, B
         case 0x41: reg.b = reg.c;                                                   return; // LD B, C
@@ -884,17 +1679,17 @@ auto CPU::step() noexcept -> void
         case 0xBD: sub(reg.l,              ALUFlag::DiscardResult);                 return; // CP L
         case 0xBE: sub(m_bus.read(reg.hl), ALUFlag::DiscardResult);                 return; // CP (HL)
         case 0xBF: sub(reg.a,              ALUFlag::DiscardResult);                 return; // CP A
-        case 0xC0: ret(!(reg.f & FlagBit::Zero), OpFlag::TrulyConditional);         return; // RET NZ
+        case 0xC0: ret(!(flags() & FlagBit::Zero), OpFlag::TrulyConditional);       return; // RET NZ
         case 0xC1: reg.bc = stack_pop();                                            return; // POP BC
-        case 0xC2: jp(!(reg.f & FlagBit::Zero));                                    return; // JP NZ, $imm16
+        case 0xC2: jp(!(flags() & FlagBit::Zero));                                  return; // JP NZ, $imm16
         case 0xC3: jp(true);                                                        return; // JP $imm16
-        case 0xC4: call(!(reg.f & FlagBit::Zero));                                  return; // CALL NZ, $imm16
+        case 0xC4: call(!(flags() & FlagBit::Zero));                                return; // CALL NZ, $imm16
         case 0xC5: stack_push(reg.bc);                                              return; // PUSH BC
         case 0xC6: add(read_next_byte());                                           return; // ADD A, $imm8
         case 0xC7: rst(0x0000);                                                     return; // RST $0000
-        case 0xC8: ret(reg.f & FlagBit::Zero, OpFlag::TrulyConditional);            return; // RET Z
+        case 0xC8: ret(flags() & FlagBit::Zero, OpFlag::TrulyConditional);          return; // RET Z
         case 0xC9: ret(true);                                                       return; // RET
-        case 0xCA: jp(reg.f & FlagBit::Zero);                                       return; // JP Z, $imm16
+        case 0xCA: jp(flags() & FlagBit::Zero);                                     return; // JP Z, $imm16
 
         // CB-prefixed instruction
         case 0xCB:
@@ -906,7 +1701,7 @@ auto CPU::step() noexcept -> void
                 case 0x03: reg.e = rlc(reg.e);                                     return; // RLC E
                 case 0x04: reg.h = rlc(reg.h);                                     return; // RLC H
                 case 0x05: reg.l = rlc(reg.l);                                     return; // RLC L
-                case 0x06: rw_hl(std::bind(&CPU::rlc, this, _1, ALUFlag::Normal)); return; // RLC (HL)
+                case 0x06: rw_hl([this](const uint8_t n) { return rlc(n); }); return; // RLC (HL)
                 case 0x07: reg.a = rlc(reg.a);                                     return; // RLC A
                 case 0x08: reg.b = rrc(reg.b);                                     return; // RRC B
                 case 0x09: reg.c = rrc(reg.c);                                     return; // RRC C
@@ -914,7 +1709,7 @@ auto CPU::step() noexcept -> void
                 case 0x0B: reg.e = rrc(reg.e);                                     return; // RRC E
                 case 0x0C: reg.h = rrc(reg.h);                                     return; // RRC H
                 case 0x0D: reg.l = rrc(reg.l);                                     return; // RRC L
-                case 0x0E: rw_hl(std::bind(&CPU::rrc, this, _1, ALUFlag::Normal)); return; // RRC (HL)
+                case 0x0E: rw_hl([this](const uint8_t n) { return rrc(n); }); return; // RRC (HL)
                 case 0x0F: reg.a = rrc(reg.a);                                     return; // RRC A
                 case 0x10: reg.b = rl(reg.b);                                      return; // RL B
                 case 0x11: reg.c = rl(reg.c);                                      return; // RL C
@@ -922,7 +1717,7 @@ auto CPU::step() noexcept -> void
                 case 0x13: reg.e = rl(reg.e);                                      return; // RL E
                 case 0x14: reg.h = rl(reg.h);                                      return; // RL H
                 case 0x15: reg.l = rl(reg.l);                                      return; // RL L
-                case 0x16: rw_hl(std::bind(&CPU::rl, this, _1, ALUFlag::Normal));  return; // RL (HL)
+                case 0x16: rw_hl([this](const uint8_t n) { return rl(n); }); return; // RL (HL)
                 case 0x17: reg.a = rl(reg.a);                                      return; // RL A
                 case 0x18: reg.b = rr(reg.b);                                      return; // RR B
                 case 0x19: reg.c = rr(reg.c);                                      return; // RR C
@@ -930,7 +1725,7 @@ auto CPU::step() noexcept -> void
                 case 0x1B: reg.e = rr(reg.e);                                      return; // RR E
                 case 0x1C: reg.h = rr(reg.h);                                      return; // RR H
                 case 0x1D: reg.l = rr(reg.l);                                      return; // RR L
-                case 0x1E: rw_hl(std::bind(&CPU::rr, this, _1, ALUFlag::Normal));  return; // RR (HL)
+                case 0x1E: rw_hl([this](const uint8_t n) { return rr(n); }); return; // RR (HL)
                 case 0x1F: reg.a = rr(reg.a);                                      return; // RR A
                 case 0x20: reg.b = sla(reg.b);                                     return; // SLA B
                 case 0x21: reg.c = sla(reg.c);                                     return; // SLA C
@@ -938,7 +1733,7 @@ auto CPU::step() noexcept -> void
                 case 0x23: reg.e = sla(reg.e);                                     return; // SLA E
                 case 0x24: reg.h = sla(reg.h);                                     return; // SLA H
                 case 0x25: reg.l = sla(reg.l);                                     return; // SLA L
-                case 0x26: rw_hl(std::bind(&CPU::sla, this, _1));                  return; // SLA (HL)
+                case 0x26: rw_hl([this](const uint8_t n) { return sla(n); }); return; // SLA (HL)
                 case 0x27: reg.a = sla(reg.a);                                     return; // SLA A
                 case 0x28: reg.b = sra(reg.b);                                     return; // SRA B
                 case 0x29: reg.c = sra(reg.c);                                     return; // SRA C
@@ -946,7 +1741,7 @@ auto CPU::step() noexcept -> void
                 case 0x2B: reg.e = sra(reg.e);                                     return; // SRA E
                 case 0x2C: reg.h = sra(reg.h);                                     return; // SRA H
                 case 0x2D: reg.l = sra(reg.l);                                     return; // SRA L
-                case 0x2E: rw_hl(std::bind(&CPU::sra, this, _1));                  return; // SRA (HL)
+                case 0x2E: rw_hl([this](const uint8_t n) { return sra(n); }); return; // SRA (HL)
                 case 0x2F: reg.a = sra(reg.a);                                     return; // SRA A
                 case 0x30: reg.b = swap(reg.b);                                    return; // SWAP B
                 case 0x31: reg.c = swap(reg.c);                                    return; // SWAP C
@@ -954,7 +1749,7 @@ auto CPU::step() noexcept -> void
                 case 0x33: reg.e = swap(reg.e);                                    return; // SWAP E
                 case 0x34: reg.h = swap(reg.h);                                    return; // SWAP H
                 case 0x35: reg.l = swap(reg.l);                                    return; // SWAP L
-                case 0x36: rw_hl(std::bind(&CPU::swap, this, _1));                 return; // SWAP (HL)
+                case 0x36: rw_hl([this](const uint8_t n) { return swap(n); }); return; // SWAP (HL)
                 case 0x37: reg.a = swap(reg.a);                                    return; // SWAP A
                 case 0x38: reg.b = srl(reg.b);                                     return; // SRL B
                 case 0x39: reg.c = srl(reg.c);                                     return; // SRL C
@@ -962,7 +1757,7 @@ auto CPU::step() noexcept -> void
                 case 0x3B: reg.e = srl(reg.e);                                     return; // SRL E
                 case 0x3C: reg.h = srl(reg.h);                                     return; // SRL H
                 case 0x3D: reg.l = srl(reg.l);                                     return; // SRL L
-                case 0x3E: rw_hl(std::bind(&CPU::srl, this, _1));                  return; // SRL (HL)
+                case 0x3E: rw_hl([this](const uint8_t n) { return srl(n); }); return; // SRL (HL)
                 case 0x3F: reg.a = srl(reg.a);                                     return; // SRL A
                 case 0x40: bit(0, reg.b);                                          return; // BIT 0, B
                 case 0x41: bit(0, reg.c);                                          return; // BIT 0, C
@@ -1158,21 +1953,21 @@ auto CPU::step() noexcept -> void
                 case 0xFF: reg.a |= (1 << 7);                                      return; // SET 7, A
             }
 
-        case 0xCC: call(reg.f & FlagBit::Zero);                                   return; // CALL Z, $imm16
+        case 0xCC: call(flags() & FlagBit::Zero);                                 return; // CALL Z, $imm16
         case 0xCD: call(true);                                                    return; // CALL $imm16
         case 0xCE: add(read_next_byte(), ALUFlag::WithCarry);                     return; // ADC A, $imm8
         case 0xCF: rst(0x0008);                                                   return; // RST $08
-        case 0xD0: ret(!(reg.f & FlagBit::Carry), OpFlag::TrulyConditional);      return; // RET NC
+        case 0xD0: ret(!carry(), OpFlag::TrulyConditional);                       return; // RET NC
         case 0xD1: reg.de = stack_pop();                                          return; // POP DE
-        case 0xD2: jp(!(reg.f & FlagBit::Carry));                                 return; // JP NC, $imm16
-        case 0xD4: call(!(reg.f & FlagBit::Carry));                               return; // CALL NC, $imm16
+        case 0xD2: jp(!carry());                                                  return; // JP NC, $imm16
+        case 0xD4: call(!carry());                                                return; // CALL NC, $imm16
         case 0xD5: stack_push(reg.de);                                            return; // PUSH DE
         case 0xD6: sub(read_next_byte());                                         return; // SUB $imm8
         case 0xD7: rst(0x0010);                                                   return; // RST $0010
-        case 0xD8: ret(reg.f & FlagBit::Carry, OpFlag::TrulyConditional);         return; // RET C
+        case 0xD8: ret(carry(), OpFlag::TrulyConditional);                        return; // RET C
         case 0xD9: ret(true); ime = true;                                         return; // RETI
-        case 0xDA: jp(reg.f & FlagBit::Carry);                                    return; // JP C, $imm16
-        case 0xDC: call(reg.f & FlagBit::Carry);                                  return; // CALL C, $imm16
+        case 0xDA: jp(carry());                                                   return; // JP C, $imm16
+        case 0xDC: call(carry());                                                 return; // CALL C, $imm16
         case 0xDE: sub(read_next_byte(), ALUFlag::WithCarry);                     return; // SBC A, $imm8
         case 0xDF: rst(0x0018);                                                   return; // RST $0018
         case 0xE0: m_bus.write(0xFF00 + read_next_byte(), reg.a);                 return; // LDH ($imm8), A
@@ -1187,10 +1982,10 @@ auto CPU::step() noexcept -> void
         case 0xEE: bit_op(std::bit_xor<uint8_t>(), read_next_byte(), 0x80, 0x00); return; // XOR $imm8
         case 0xEF: rst(0x0028);                                                   return; // RST $0028
         case 0xF0: reg.a = m_bus.read(0xFF00 + read_next_byte());                 return; // LDH A, ($imm8)
-        case 0xF1: reg.af = stack_pop() & ~0x0F;                                  return; // POP AF
+        case 0xF1: reg.af = stack_pop() & ~0x0F; pending_flags.operation = FlagOperation::None; return; // POP AF
         case 0xF2: reg.a = m_bus.read(0xFF00 + reg.c);                            return; // LD A, (C)
         case 0xF3: ime = false;                                                   return; // DI
-        case 0xF5: stack_push(reg.af);                                            return; // PUSH AF
+        case 0xF5: sync_flags(); stack_push(reg.af);                              return; // PUSH AF
         case 0xF6: bit_op(std::bit_or<uint8_t>(), read_next_byte(), 0x80, 0x00);  return; // OR $imm8
         case 0xF7: rst(0x0030);                                                   return; // RST $0030
         case 0xF8: reg.hl = add_sp();                                             return; // LD HL, SP+$simm8
@@ -1201,4 +1996,5 @@ auto CPU::step() noexcept -> void
         case 0xFF: rst(0x0038);                                                   return; // RST $0038
         default:                                                                  return;
     }
-}
\ No newline at end of file
+#endif
+}
@@ -0,0 +1,175 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <fmt/printf.h>
+#include "frame_pacer.h"
+
+using namespace GameBoy;
+
+/// @brief Initializes a frame pacer.
+/// @param period The time between frames.
+FramePacer::FramePacer(const Clock::duration period) noexcept :
+m_period(period)
+{
+    clear();
+    reset();
+}
+
+/// @brief Schedules the next frame a period from now, i.e. when the run loop
+/// starts or resumes. The histogram is left untouched.
+auto FramePacer::reset() noexcept -> void
+{
+    m_deadline = Clock::now() + m_period;
+    m_has_previous = false;
+}
+
+/// @brief Waits until the next frame is due.
+///
+/// If the frame is already late by more than a period, the frames missed are
+/// skipped over rather than rushed through to catch up.
+auto FramePacer::wait() noexcept -> void
+{
+    const auto now{ Clock::now() };
+
+    if (now >= m_deadline)
+    {
+        m_late++;
+
+        if ((now - m_deadline) > m_period)
+        {
+            m_deadline = now;
+        }
+    }
+    else
+    {
+        if ((m_deadline - now) > SPIN_TIME)
+        {
+            std::this_thread::sleep_until(m_deadline - SPIN_TIME);
+        }
+
+        // Spin for the rest, which the sleep may have overshot already.
+        while (Clock::now() < m_deadline)
+        { }
+    }
+
+    const auto done{ Clock::now() };
+    m_deadline += m_period;
+
+    if (m_has_previous)
+    {
+        const std::chrono::duration<double> interval{ done - m_previous };
+        const auto bucket
+        {
+            static_cast<std::size_t>((done - m_previous) / BUCKET_WIDTH)
+        };
+
+        m_histogram[std::min(bucket, BUCKETS - 1)]++;
+        m_frames++;
+
+        m_sum += interval.count();
+        m_sum_squares += interval.count() * interval.count();
+
+        m_min = (m_frames == 1) ? interval.count()
+                                : std::min(m_min, interval.count());
+        m_max = std::max(m_max, interval.count());
+    }
+
+    m_previous = done;
+    m_has_previous = true;
+}
+
+/// @brief Clears the histogram and the statistics.
+auto FramePacer::clear() noexcept -> void
+{
+    m_histogram.fill(0);
+
+    m_frames = 0;
+    m_late = 0;
+
+    m_sum = 0.0;
+    m_sum_squares = 0.0;
+    m_min = 0.0;
+    m_max = 0.0;
+}
+
+/// @brief Returns the histogram of the time between frames.
+/// @return The number of frames in each bucket of `BUCKET_WIDTH`.
+auto FramePacer::histogram() const noexcept
+-> const std::array<uint64_t, BUCKETS>&
+{
+    return m_histogram;
+}
+
+/// @brief Formats the statistics and the histogram for display.
+/// @return The report, one line per nonempty bucket after a summary.
+auto FramePacer::report() const -> std::string
+{
+    const double target{ std::chrono::duration<double>(m_period).count() };
+    const double mean{ m_frames ? (m_sum / m_frames) : 0.0 };
+    const double variance
+    {
+        m_frames ? std::max((m_sum_squares / m_frames) - (mean * mean), 0.0)
+                 : 0.0
+    };
+
+    std::string report
+    {
+        fmt::sprintf("frames:     %llu, %llu late\n"
+                     "interval:   %.3f ms avg, %.3f ms stddev, "
+                     "%.3f ms min, %.3f ms max (target %.3f ms)\n",
+                     static_cast<unsigned long long>(m_frames),
+                     static_cast<unsigned long long>(m_late),
+                     mean * 1e3,
+                     std::sqrt(variance) * 1e3,
+                     m_min * 1e3,
+                     m_max * 1e3,
+                     target * 1e3)
+    };
+
+    const uint64_t peak
+    {
+        *std::max_element(m_histogram.begin(), m_histogram.end())
+    };
+
+    const double width
+    {
+        std::chrono::duration<double, std::milli>(BUCKET_WIDTH).count()
+    };
+
+    for (std::size_t bucket{ 0 }; bucket < BUCKETS; ++bucket)
+    {
+        if (!m_histogram[bucket])
+        {
+            continue;
+        }
+
+        // Every nonempty bucket gets at least one mark, however small.
+        const std::size_t marks
+        {
+            std::max<std::size_t>((m_histogram[bucket] * 50) / peak, 1)
+        };
+
+        report += fmt::sprintf("%6.1f ms%s %8llu %s\n",
+                               bucket * width,
+                               (bucket == BUCKETS - 1) ? "+" : " ",
+                               static_cast<unsigned long long>
+                               (m_histogram[bucket]),
+                               std::string(marks, '#'));
+    }
+    return report;
+}
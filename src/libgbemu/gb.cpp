@@ -12,13 +12,16 @@
 // OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
 // CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
+#include <cstring>
 #include <stdexcept>
+#include <vector>
 #include <fmt/printf.h>
 #include "../cart/mbc1.h"
 #include "../cart/mbc3.h"
 #include "../cart/mbc1.h"
 #include "../cart/rom_only.h"
 #include "gb.h"
+#include "state.h"
 
 using namespace GameBoy;
 
@@ -33,6 +36,8 @@ auto System::reset() noexcept -> void
 {
     bus.reset();
     cpu.reset();
+
+    frame_cycles = 0;
 }
 
 /// @brief Presses a button on the virtual joypad.
@@ -57,41 +62,45 @@ auto System::release_button(const JoypadButton button) noexcept -> void
 /// * The header checksum verification failed, or;
 /// * The ROM requires a memory bank controller we don't support.
 /// 
-/// @param cart_data The data to use to generate the Cartridge instance.
+/// @param cart_data The data to use to generate the Cartridge instance. It is
+/// copied into a ROM image of its own.
 /// @return The generated cartridge.
 auto System::cart(const std::vector<uint8_t>& cart_data) ->
 std::shared_ptr<Cartridge>
 {
-    // First, we check to see if the header checksum is valid. We use the
-    // `at()` method to access the cartridge data since we're not sure if the
-    // indicies referenced below actually exist, and referencing them using
-    // `operator[]` could lead to undefined behavior.
-    unsigned int x{ 0 };
+    return cart(RomImage::from_data(cart_data));
+}
 
-    for (unsigned int i{ 0x0134 }; i <= 0x014C; ++i)
+/// @brief Generates a cartridge referencing a ROM image, without copying it.
+/// 
+/// This function will throw an `std::runtime_error` under the following
+/// circumstances:
+/// 
+/// * The header checksum verification failed, or;
+/// * The ROM requires a memory bank controller we don't support.
+/// 
+/// @param rom The ROM image to use to generate the Cartridge instance.
+/// @return The generated cartridge.
+auto System::cart(const std::shared_ptr<const RomImage>& rom) ->
+std::shared_ptr<Cartridge>
+{
+    // First, we check to see if the header checksum is valid. We check the
+    // size of the image first, since the indicies referenced below might not
+    // actually exist.
+    if (rom->size() <= 0x014D)
     {
-        try
-        {
-            x = x - cart_data.at(i) - 1;
-        }
-        catch (std::out_of_range&)
-        {
-            throw std::runtime_error("Header checksum verification failed.");
-        }
+        throw std::runtime_error("Header checksum verification failed.");
     }
 
-    uint8_t checksum;
+    const RomImage& cart_data{ *rom };
+    unsigned int x{ 0 };
 
-    try
-    {
-        checksum = cart_data.at(0x014D);
-    }
-    catch (std::out_of_range&)
+    for (unsigned int i{ 0x0134 }; i <= 0x014C; ++i)
     {
-        throw std::runtime_error("Header checksum verification failed.");
+        x = x - cart_data[i] - 1;
     }
 
-    if ((x & 0xFF) != checksum)
+    if ((x & 0xFF) != cart_data[0x014D])
     {
         throw std::runtime_error("Header checksum verification failed.");
     }
@@ -105,17 +114,17 @@ std::shared_ptr<Cartridge>
         // ROM ONLY
         case 0x00:
         case 0x03:
-            cart = std::make_shared<GameBoy::ROMOnlyCartridge>(cart_data);
+            cart = std::make_shared<GameBoy::ROMOnlyCartridge>(rom);
             break;
 
         // MBC1
         case 0x01:
-            cart = std::make_shared<GameBoy::MBC1Cartridge>(cart_data);
+            cart = std::make_shared<GameBoy::MBC1Cartridge>(rom);
             break;
 
         // MBC3+RAM+BATTERY
         case 0x13:
-            cart = std::make_shared<GameBoy::MBC3Cartridge>(cart_data);
+            cart = std::make_shared<GameBoy::MBC3Cartridge>(rom);
             break;
     }
 
@@ -167,3 +176,185 @@ auto System::step() noexcept -> unsigned int
 
     return cycles;
 }
+
+/// @brief Executes steps until a frame's worth of T-cycles has elapsed.
+///
+/// The last step usually overshoots the end of the frame, and the excess is
+/// taken off the next frame, so that frames keep in step with the LCD over
+/// time.
+/// @return The number of T-cycles taken by the steps executed.
+auto System::run_frame() noexcept -> unsigned int
+{
+    unsigned int cycles{ 0 };
+
+    while (frame_cycles < CYCLES_PER_FRAME)
+    {
+        const unsigned int step_cycles{ step() };
+
+        frame_cycles += step_cycles;
+        cycles += step_cycles;
+    }
+
+    frame_cycles -= CYCLES_PER_FRAME;
+    return cycles;
+}
+
+/// @brief Sets which frames are rendered, i.e. to skip rendering when only
+/// some frames are looked at. Changes take effect from the next frame on.
+/// @param policy The render policy.
+/// @param interval With `RenderPolicy::EveryNth`, one frame out of this many
+/// is rendered.
+auto System::render_policy(const RenderPolicy policy,
+                           const unsigned int interval) noexcept -> void
+{
+    bus.ppu.render_policy = policy;
+    bus.ppu.render_interval = interval;
+}
+
+/// @brief Requests the next frame to be rendered, with
+/// `RenderPolicy::OnRequest`.
+auto System::request_frame() noexcept -> void
+{
+    bus.ppu.request_frame();
+}
+
+/// @brief Returns the size of a save state of the system, which depends on the
+/// cartridge.
+/// @return The size of a save state, in bytes.
+auto System::state_size() noexcept -> std::size_t
+{
+    StateSerializer state;
+    serialize(state);
+
+    return state.offset();
+}
+
+/// @brief Saves the state of the system to a buffer, without allocating any
+/// memory.
+///
+/// The state is a flat binary image of every device, preceded by a header
+/// identifying the format and the cartridge. The frame being rendered is not
+/// part of it.
+/// @param data The buffer to save the state to.
+/// @param size The size of the buffer, which must be at least `state_size()`.
+/// @return The size of the state, or 0 if the buffer is too small.
+auto System::save_state(uint8_t* data, const std::size_t size) noexcept
+-> std::size_t
+{
+    StateSerializer state{ data, size };
+    serialize(state);
+
+    return state.overflowed() ? 0 : state.offset();
+}
+
+/// @brief Loads a state saved by `save_state()`, without allocating any
+/// memory.
+/// @param data The buffer to load the state from.
+/// @param size The size of the buffer.
+/// @return `true` if the state was loaded, or `false` if it is truncated, of a
+/// different version or for a different cartridge, in which case the system is
+/// left untouched.
+auto System::load_state(const uint8_t* data, const std::size_t size) noexcept
+-> bool
+{
+    // Everything is checked up front, so that a state is never loaded
+    // halfway.
+    if (size < state_size())
+    {
+        return false;
+    }
+
+    const StateHeader expected{ state_header() };
+    StateHeader header;
+
+    std::memcpy(&header, data, sizeof(header));
+
+    if ((header.magic != expected.magic)     ||
+        (header.version != expected.version) ||
+        (header.cart_id != expected.cart_id))
+    {
+        return false;
+    }
+
+    StateSerializer state{ data, size };
+    serialize(state);
+
+    return true;
+}
+
+/// @brief Forks the system, i.e. for a tree search.
+///
+/// The child starts out in the exact state of this system, and runs
+/// independently of it from then on. WRAM, VRAM and cartridge RAM are shared
+/// between the two until either writes to a 4KB page of them, which is copied
+/// then, and the ROM image is shared for good, so that forking takes
+/// microseconds. The frame being rendered is not copied, and the child decodes
+/// or recompiles code afresh.
+/// @return The child.
+auto System::fork() -> std::unique_ptr<System>
+{
+    auto child{ std::make_unique<System>() };
+    child->bus.share_memory(bus);
+
+    // Everything else amounts to a few hundred bytes, which are passed through
+    // a save state leaving out the shared memory.
+    StateSerializer measure{ false };
+    serialize(measure);
+
+    std::vector<uint8_t> data(measure.offset());
+
+    StateSerializer save{ data.data(), data.size(), false };
+    serialize(save);
+
+    const uint8_t* const saved{ data.data() };
+    StateSerializer load{ saved, data.size(), false };
+    child->serialize(load);
+
+    child->cpu.mode = cpu.mode;
+    child->cpu.idle_loops.enabled = cpu.idle_loops.enabled;
+
+    child->render_policy(bus.ppu.render_policy, bus.ppu.render_interval);
+    child->bus.ppu.render_progress = bus.ppu.render_progress;
+
+    return child;
+}
+
+/// @brief Returns the header a state of the system is saved with.
+/// @return The header.
+auto System::state_header() noexcept -> StateHeader
+{
+    // The cartridge is identified by a hash of its header, which covers the
+    // title, the memory bank controller and the header checksum, or by 0 if
+    // there is none.
+    if (!bus.has_cart())
+    {
+        return { STATE_MAGIC, STATE_VERSION, 0 };
+    }
+
+    uint32_t cart_id{ 0x811C9DC5 };
+
+    for (uint16_t address{ 0x0134 }; address <= 0x014D; ++address)
+    {
+        cart_id ^= bus.read(address, AccessType::Direct);
+        cart_id *= 0x01000193;
+    }
+    return { STATE_MAGIC, STATE_VERSION, cart_id };
+}
+
+/// @brief Saves or loads the state of every device.
+/// @param state The save state serializer.
+auto System::serialize(StateSerializer& state) noexcept -> void
+{
+    StateHeader header{ };
+
+    if (state.saving())
+    {
+        header = state_header();
+    }
+
+    state.field(header);
+    state.field(frame_cycles);
+
+    cpu.serialize(state);
+    bus.serialize(state);
+}
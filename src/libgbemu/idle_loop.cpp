@@ -0,0 +1,314 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include "bus.h"
+#include "cpu.h"
+#include "idle_loop.h"
+
+using namespace GameBoy;
+
+/// @brief The maximum distance in bytes between the start of a loop and the
+/// branch back to it.
+constexpr unsigned int MAX_LOOP_LENGTH{ 16 };
+
+/// @brief Initializes the detector.
+/// @param bus The system bus the loops read from.
+IdleLoopDetector::IdleLoopDetector(SystemBus& bus) noexcept : m_bus(bus)
+{
+    enabled = false;
+    reset();
+}
+
+/// @brief Resets the detector and its counters to the startup state.
+auto IdleLoopDetector::reset() noexcept -> void
+{
+    hits = 0;
+    cycles_skipped = 0;
+
+    forget();
+}
+
+/// @brief Stops watching the current loop, i.e. because the state of the
+/// system was replaced. The counters are left untouched.
+auto IdleLoopDetector::forget() noexcept -> void
+{
+    previous_pc = 0x0000;
+
+    loop.head = 0x0000;
+    loop.branch = 0x0000;
+
+    visit.valid = false;
+}
+
+/// @brief Checks the instruction the CPU is about to execute.
+/// @param cpu The CPU instance.
+/// @return The number of T-cycles to advance the system by before executing
+/// the instruction, 0 if it isn't the start of an idle loop.
+auto IdleLoopDetector::check(const CPU& cpu) noexcept -> unsigned int
+{
+    const uint16_t pc{ cpu.reg.pc };
+    const uint16_t previous{ previous_pc };
+    previous_pc = pc;
+
+    if ((pc != loop.head) || (previous != loop.branch))
+    {
+        // Only an iteration that ran from the start of the loop straight
+        // through to its branch says anything about the next one.
+        const bool in_body{ (previous >= loop.head) &&
+                            (previous < pc) &&
+                            (pc <= loop.branch) };
+
+        if (!in_body)
+        {
+            visit.valid = false;
+        }
+
+        if ((pc <= previous) &&
+            (static_cast<unsigned int>(previous - pc) < MAX_LOOP_LENGTH))
+        {
+            loop.head = pc;
+            loop.branch = previous;
+        }
+        return 0;
+    }
+
+    const uint64_t now{ m_bus.sched.timestamp };
+
+    const Registers registers
+    {
+        static_cast<uint16_t>((cpu.reg.a << 8) | cpu.flags()),
+        cpu.reg.bc,
+        cpu.reg.de,
+        cpu.reg.hl,
+        cpu.reg.sp
+    };
+
+    if (!visit.valid ||
+        (visit.registers != registers) ||
+        (visit.events != m_bus.events_dispatched) ||
+        (visit.rom_generation != m_bus.rom_generation))
+    {
+        // Nothing in the loop writes to memory, so its instructions stay the
+        // same as long as it keeps running, unless a bank was switched in by
+        // an event handler.
+        if (!visit.valid ||
+            (visit.registers[3] != cpu.reg.hl) ||
+            (visit.rom_generation != m_bus.rom_generation))
+        {
+            visit.idle = analyze(cpu.reg.hl);
+        }
+
+        visit.valid = true;
+        visit.registers = registers;
+        visit.timestamp = now;
+        visit.events = m_bus.events_dispatched;
+        visit.rom_generation = m_bus.rom_generation;
+
+        return 0;
+    }
+
+    const uint64_t length{ now - visit.timestamp };
+    const uint64_t until_event{ m_bus.sched.until_next_event() };
+
+    visit.timestamp = now;
+
+    // The iteration the next event is dispatched in is left to run normally,
+    // as is the one before it, since the reads might happen past its end.
+    if (!visit.idle || (length == 0) || (until_event < (2 * length)))
+    {
+        return 0;
+    }
+
+    const uint64_t skip{ ((until_event / length) - 1) * length };
+
+    visit.timestamp += skip;
+
+    hits++;
+    cycles_skipped += skip;
+
+    return static_cast<unsigned int>(skip);
+}
+
+/// @brief Determines if the current loop can be skipped, based on its
+/// instructions alone.
+/// @param hl The value of register pair HL throughout the loop.
+/// @return `true` if the loop neither writes to memory nor reads from memory an
+/// instruction could change, or `false` otherwise.
+auto IdleLoopDetector::analyze(const uint16_t hl) const noexcept -> bool
+{
+    const auto read
+    {
+        [this](const uint16_t address)
+        {
+            return m_bus.read(address, AccessType::Direct);
+        }
+    };
+
+    bool reads_hl{ false };
+    bool writes_hl{ false };
+
+    for (uint16_t pc{ loop.head };
+         static_cast<uint16_t>(pc - loop.head) < MAX_LOOP_LENGTH;)
+    {
+        const uint8_t opcode{ read(pc) };
+
+        const unsigned int x{ (opcode >> 6u) & 3u };
+        const unsigned int y{ (opcode >> 3) & 7u };
+        const unsigned int z{ opcode & 7u };
+
+        // Instructions writing to register H or L.
+        const bool writes_h_or_l{ (y == 4) || (y == 5) };
+
+        switch (opcode)
+        {
+            // The first branch must go back to the start of the loop.
+            case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR
+            {
+                const auto offset{ static_cast<int8_t>(read(pc + 1)) };
+
+                if (static_cast<uint16_t>(pc + 2 + offset) != loop.head)
+                {
+                    return false;
+                }
+                return !reads_hl || (!writes_hl && stable(hl));
+            }
+
+            case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA: // JP
+                if (((read(pc + 2) << 8) | read(pc + 1)) != loop.head)
+                {
+                    return false;
+                }
+                return !reads_hl || (!writes_hl && stable(hl));
+
+            default:
+                break;
+        }
+
+        switch (x)
+        {
+            case 0:
+                if (opcode == 0x00)
+                {
+                    pc += 1; // NOP
+                    break;
+                }
+
+                if (((z == 4) || (z == 5)) && (y != 6))
+                {
+                    writes_hl |= writes_h_or_l; // INC r, DEC r
+                    pc += 1;
+                    break;
+                }
+
+                if ((z == 6) && (y != 6))
+                {
+                    writes_hl |= writes_h_or_l; // LD r, $imm8
+                    pc += 2;
+                    break;
+                }
+
+                if (z == 7)
+                {
+                    pc += 1; // RLCA ... CCF
+                    break;
+                }
+                return false;
+
+            case 1:
+                if (y == 6)
+                {
+                    return false; // LD (HL), r; HALT
+                }
+
+                reads_hl |= (z == 6); // LD r, (HL)
+                writes_hl |= writes_h_or_l;
+
+                pc += 1;
+                break;
+
+            case 2:
+                reads_hl |= (z == 6); // ALU A, r
+                pc += 1;
+                break;
+
+            case 3:
+                if (z == 6)
+                {
+                    pc += 2; // ALU A, $imm8
+                    break;
+                }
+
+                if (opcode == 0xF0) // LDH A, ($imm8)
+                {
+                    if (!stable(0xFF00 + read(pc + 1)))
+                    {
+                        return false;
+                    }
+
+                    pc += 2;
+                    break;
+                }
+
+                if (opcode == 0xFA) // LD A, ($imm16)
+                {
+                    if (!stable((read(pc + 2) << 8) | read(pc + 1)))
+                    {
+                        return false;
+                    }
+
+                    pc += 3;
+                    break;
+                }
+
+                if (opcode == 0xCB)
+                {
+                    const uint8_t cb{ read(pc + 1) };
+                    const bool bit{ (cb >> 6) == 1 };
+
+                    if ((cb & 7) == 6)
+                    {
+                        // Everything but BIT writes the result back.
+                        if (!bit)
+                        {
+                            return false;
+                        }
+                        reads_hl = true;
+                    }
+                    else if (!bit)
+                    {
+                        writes_hl |= ((cb & 7) == 4) || ((cb & 7) == 5);
+                    }
+
+                    pc += 2;
+                    break;
+                }
+                return false;
+        }
+    }
+    return false;
+}
+
+/// @brief Determines if memory at an address can only change when an event is
+/// dispatched or the CPU writes to it.
+/// @param address The address to check.
+/// @return `true` if the memory is stable, or `false` otherwise.
+auto IdleLoopDetector::stable(const uint16_t address) noexcept -> bool
+{
+    return (address <= 0x7FFF) ||                         // ROM
+           ((address >= 0xC000) && (address <= 0xFDFF)) || // WRAM and echo
+           (address == 0xFF0F) ||                          // IF
+           ((address >= 0xFF40) && (address <= 0xFF45)) || // LCDC ... LYC
+           ((address >= 0xFF47) && (address <= 0xFF4B)) || // BGP ... WX
+           (address >= 0xFF80);                            // HRAM, IE
+}
@@ -0,0 +1,237 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "cpu.h"
+
+// Lookup tables for the 8-bit arithmetic instructions, generated at compile
+// time and used instead of computing the flags if `GBEMU_ALU_TABLES` is
+// defined.
+//
+// Every entry holds the value of register pair AF after the operation: the
+// result in the upper 8 bits, and the Flag (F) register in the lower 8 bits.
+
+namespace GameBoy
+{
+    /// @brief Generates the table for ADD and ADC.
+    /// @return The table, indexed by `(carry << 16) | (a << 8) | operand`.
+    constexpr auto make_add_table() noexcept -> std::array<uint16_t, 0x20000>
+    {
+        std::array<uint16_t, 0x20000> table{ };
+
+        for (unsigned int carry{ 0 }; carry < 2; ++carry)
+        {
+            for (unsigned int a{ 0 }; a < 256; ++a)
+            {
+                for (unsigned int n{ 0 }; n < 256; ++n)
+                {
+                    const unsigned int result{ a + n + carry };
+                    unsigned int f{ 0 };
+
+                    if ((result & 0xFF) == 0)
+                    {
+                        f |= CPU::FlagBit::Zero;
+                    }
+
+                    if ((a ^ n ^ result) & 0x10)
+                    {
+                        f |= CPU::FlagBit::HalfCarry;
+                    }
+
+                    if (result > 0xFF)
+                    {
+                        f |= CPU::FlagBit::Carry;
+                    }
+
+                    table[(carry << 16) | (a << 8) | n] =
+                    static_cast<uint16_t>(((result & 0xFF) << 8) | f);
+                }
+            }
+        }
+        return table;
+    }
+
+    /// @brief Generates the table for SUB, SBC and CP.
+    /// @return The table, indexed by `(carry << 16) | (a << 8) | operand`.
+    constexpr auto make_sub_table() noexcept -> std::array<uint16_t, 0x20000>
+    {
+        std::array<uint16_t, 0x20000> table{ };
+
+        for (unsigned int carry{ 0 }; carry < 2; ++carry)
+        {
+            for (unsigned int a{ 0 }; a < 256; ++a)
+            {
+                for (unsigned int n{ 0 }; n < 256; ++n)
+                {
+                    const int result{ static_cast<int>(a - n - carry) };
+                    unsigned int f{ CPU::FlagBit::Subtract };
+
+                    if ((result & 0xFF) == 0)
+                    {
+                        f |= CPU::FlagBit::Zero;
+                    }
+
+                    if ((a ^ n ^ result) & 0x10)
+                    {
+                        f |= CPU::FlagBit::HalfCarry;
+                    }
+
+                    if (result < 0)
+                    {
+                        f |= CPU::FlagBit::Carry;
+                    }
+
+                    table[(carry << 16) | (a << 8) | n] =
+                    static_cast<uint16_t>(((result & 0xFF) << 8) | f);
+                }
+            }
+        }
+        return table;
+    }
+
+    /// @brief Generates the table for INC or DEC.
+    /// @param delta 1 for INC, or -1 for DEC.
+    /// @return The table, indexed by the value to increment or decrement. The
+    /// Carry flag is always reset, as the instructions leave it untouched.
+    constexpr auto make_inc_dec_table(const int delta) noexcept
+    -> std::array<uint16_t, 256>
+    {
+        std::array<uint16_t, 256> table{ };
+
+        for (unsigned int r{ 0 }; r < 256; ++r)
+        {
+            const unsigned int result{ (r + delta) & 0xFF };
+            unsigned int f{ 0 };
+
+            if (result == 0)
+            {
+                f |= CPU::FlagBit::Zero;
+            }
+
+            if (delta < 0)
+            {
+                f |= CPU::FlagBit::Subtract;
+
+                if ((r & 0x0F) == 0x00)
+                {
+                    f |= CPU::FlagBit::HalfCarry;
+                }
+            }
+            else if ((r & 0x0F) == 0x0F)
+            {
+                f |= CPU::FlagBit::HalfCarry;
+            }
+
+            table[r] = static_cast<uint16_t>((result << 8) | f);
+        }
+        return table;
+    }
+
+    /// @brief Generates the table for DAA.
+    /// @return The table, indexed by `(a << 4) | (f >> 4)`.
+    constexpr auto make_daa_table() noexcept -> std::array<uint16_t, 0x1000>
+    {
+        std::array<uint16_t, 0x1000> table{ };
+
+        for (unsigned int a{ 0 }; a < 256; ++a)
+        {
+            for (unsigned int flags{ 0 }; flags < 16; ++flags)
+            {
+                const unsigned int f_in{ flags << 4 };
+
+                unsigned int adjust{ 0 };
+                unsigned int result{ a };
+
+                if (f_in & CPU::FlagBit::HalfCarry)
+                {
+                    adjust |= 0x06;
+                }
+
+                if (f_in & CPU::FlagBit::Carry)
+                {
+                    adjust |= 0x60;
+                }
+
+                if (f_in & CPU::FlagBit::Subtract)
+                {
+                    result -= adjust;
+                }
+                else
+                {
+                    if ((a & 0x0F) > 0x09)
+                    {
+                        adjust |= 0x06;
+                    }
+
+                    if (a > 0x99)
+                    {
+                        adjust |= 0x60;
+                    }
+                    result += adjust;
+                }
+
+                result &= 0xFF;
+
+                unsigned int f{ f_in & CPU::FlagBit::Subtract };
+
+                if (result == 0)
+                {
+                    f |= CPU::FlagBit::Zero;
+                }
+
+                if (adjust & 0x60)
+                {
+                    f |= CPU::FlagBit::Carry;
+                }
+
+                table[(a << 4) | flags] =
+                static_cast<uint16_t>((result << 8) | f);
+            }
+        }
+        return table;
+    }
+
+    /// @brief ADD and ADC results.
+    inline constexpr std::array<uint16_t, 0x20000> add_table{ make_add_table() };
+
+    /// @brief SUB, SBC and CP results.
+    inline constexpr std::array<uint16_t, 0x20000> sub_table{ make_sub_table() };
+
+    /// @brief INC results.
+    inline constexpr std::array<uint16_t, 256> inc_table
+    {
+        make_inc_dec_table(1)
+    };
+
+    /// @brief DEC results.
+    inline constexpr std::array<uint16_t, 256> dec_table
+    {
+        make_inc_dec_table(-1)
+    };
+
+    /// @brief DAA results.
+    inline constexpr std::array<uint16_t, 0x1000> daa_table{ make_daa_table() };
+
+    // A few well known results, to catch the tables going out of sync with
+    // the arithmetic path.
+    static_assert(add_table[0x0FF01] == 0x00B0, "ADD $FF, $01");
+    static_assert(add_table[0x10F00] == 0x1020, "ADC $0F, $00 with carry");
+    static_assert(sub_table[0x00001] == 0xFF70, "SUB $00, $01");
+    static_assert(inc_table[0xFF]    == 0x00A0, "INC $FF");
+    static_assert(dec_table[0x10]    == 0x0F60, "DEC $10");
+    static_assert(daa_table[0x9A0]   == 0x0090, "DAA $9A");
+}
@@ -20,10 +20,17 @@
 
 namespace GameBoy
 {
+    class StateSerializer;
+    class SystemBus;
+
     /// @brief Defines the audio processing unit (APU).
     class APU
     {
     public:
+        /// @brief Initializes the audio processing unit (APU).
+        /// @param bus The system bus instance.
+        explicit APU(SystemBus& bus) noexcept;
+
         union length_duty_data
         {
             struct
@@ -339,7 +346,7 @@ namespace GameBoy
             uint8_t byte;
         } NR52;
 
-        unsigned int frame_sequencer;
+        /// @brief The step of the frame sequencer to be clocked next (0-7).
         unsigned int frame_sequencer_step;
 
         /// @brief Sets a register.
@@ -380,13 +387,24 @@ namespace GameBoy
         /// @brief Resets the APU to the startup state.
         auto reset() noexcept -> void;
 
-        /// @brief Steps the APU by 1 m-cycle.
-        auto step() noexcept -> void;
+        /// @brief Saves or loads the state of the APU.
+        ///
+        /// `samples` is output for the host, and isn't part of the state.
+        /// @param state The save state serializer.
+        auto serialize(StateSerializer& state) noexcept -> void;
+
+        /// @brief Clocks the frame sequencer and schedules the next clock.
+        /// @param timestamp The timestamp the frame sequencer was due at.
+        auto step(const uint64_t timestamp) noexcept -> void;
 
         uint8_t last_wave_ram_value_written;
 
         std::vector<float> samples;
 
         std::array<uint8_t, 32> unused_regs;
+
+    private:
+        /// @brief System bus instance
+        SystemBus& m_bus;
     };
 }
@@ -0,0 +1,173 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "gb.h"
+
+namespace GameBoy
+{
+    /// @brief Defines a runner stepping many independent systems at once, for
+    /// workloads such as search or training agents that need thousands of
+    /// frames per call rather than one.
+    ///
+    /// Every system renders straight into one shared, cache-aligned arena of
+    /// framebuffers, laid out contiguously in instance order, so that the
+    /// frames can be consumed without copying them.
+    ///
+    /// The systems are spread across a pool of worker threads, each of which
+    /// starts on a contiguous range of instances and steals instances from
+    /// the other ranges once its own is done.
+    class BatchRunner final
+    {
+    public:
+        /// @brief The alignment of the framebuffer arena, in bytes.
+        static constexpr std::size_t ARENA_ALIGNMENT{ 64 };
+
+        /// @brief Initializes a runner, with every system running the same
+        /// ROM image.
+        ///
+        /// This function will throw an `std::runtime_error` if the ROM image
+        /// can't be used to generate a cartridge.
+        /// @param rom The ROM image to run.
+        /// @param instances The number of systems to run.
+        /// @param threads The number of worker threads to use, or 0 to use
+        /// one per hardware thread, up to one per system.
+        /// @param pin_threads Pin each worker thread to a core of its own,
+        /// where supported?
+        BatchRunner(const std::shared_ptr<const RomImage>& rom,
+                    const std::size_t instances,
+                    const unsigned int threads = 0,
+                    const bool pin_threads = true);
+
+        /// @brief Stops the worker threads.
+        ~BatchRunner() noexcept;
+
+        BatchRunner(const BatchRunner&) = delete;
+        auto operator=(const BatchRunner&) -> BatchRunner& = delete;
+
+        /// @brief Returns the number of systems being run.
+        /// @return The number of systems.
+        auto size() const noexcept -> std::size_t;
+
+        /// @brief Returns the number of worker threads.
+        /// @return The number of worker threads.
+        auto threads() const noexcept -> unsigned int;
+
+        /// @brief Returns one of the systems, i.e. to configure it.
+        ///
+        /// The systems must not be touched while `step_frames()` is running.
+        /// @param index The index of the system.
+        /// @return The system.
+        auto system(const std::size_t index) noexcept -> System&;
+
+        /// @brief Sets the state of the joypad of every system.
+        /// @param inputs The buttons held down on each system, as a mask of
+        /// `JoypadButton` values, one per system.
+        /// @param count The number of entries in `inputs`. Systems past the
+        /// end keep their current state.
+        auto set_inputs(const uint8_t* inputs, const std::size_t count) noexcept
+        -> void;
+
+        /// @brief Runs every system for a number of frames.
+        /// @param frames The number of frames to run each system for.
+        /// @return The framebuffers, one per system, in the same order as the
+        /// systems.
+        auto step_frames(const unsigned int frames) noexcept
+        -> const ScreenData*;
+
+        /// @brief Returns the framebuffers, as of the last frame run.
+        /// @return The framebuffers, one per system.
+        auto framebuffers() const noexcept -> const ScreenData*;
+
+    private:
+        /// @brief The instances a worker starts out with, padded to a cache
+        /// line of its own since other workers steal from it.
+        struct alignas(ARENA_ALIGNMENT) Range
+        {
+            /// @brief The next instance to run.
+            std::atomic<std::size_t> next;
+
+            /// @brief One past the last instance in the range.
+            std::size_t end;
+        };
+
+        /// @brief Frees the framebuffer arena.
+        struct ArenaDeleter
+        {
+            /// @brief Frees the framebuffer arena.
+            /// @param arena The framebuffer arena.
+            auto operator()(ScreenData* arena) const noexcept -> void;
+        };
+
+        /// @brief Stops and joins the worker threads.
+        auto stop() noexcept -> void;
+
+        /// @brief The function run by each worker thread.
+        /// @param worker The index of the worker.
+        auto work(const unsigned int worker) noexcept -> void;
+
+        /// @brief Runs instances until there are none left, starting with the
+        /// worker's own range.
+        /// @param worker The index of the worker.
+        auto drain(const unsigned int worker) noexcept -> void;
+
+        /// @brief Pins the calling thread to a core.
+        /// @param core The index of the core.
+        static auto pin(const unsigned int core) noexcept -> void;
+
+        /// @brief The framebuffers, one per system.
+        std::unique_ptr<ScreenData[], ArenaDeleter> m_arena;
+
+        /// @brief The systems, destroyed before the arena they render into.
+        std::vector<std::unique_ptr<System>> m_systems;
+
+        /// @brief The instances each worker starts out with.
+        std::unique_ptr<Range[]> m_ranges;
+
+        /// @brief The worker threads.
+        std::vector<std::thread> m_threads;
+
+        /// @brief Guards `m_generation` and `m_stop`.
+        std::mutex m_mutex;
+
+        /// @brief Signaled when a batch is started, or the workers must stop.
+        std::condition_variable m_start;
+
+        /// @brief Signaled when the last worker finishes a batch.
+        std::condition_variable m_done;
+
+        /// @brief Incremented every time a batch is started.
+        uint64_t m_generation;
+
+        /// @brief Must the workers stop?
+        bool m_stop;
+
+        /// @brief The number of frames to run each system for in the current
+        /// batch.
+        unsigned int m_frames;
+
+        /// @brief The number of workers yet to finish the current batch.
+        std::atomic<unsigned int> m_pending;
+    };
+}
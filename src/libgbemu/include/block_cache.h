@@ -0,0 +1,128 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace GameBoy
+{
+    class CPU;
+    class SystemBus;
+
+    /// @brief Defines an instruction decoded ahead of execution.
+    struct DecodedInstruction
+    {
+        /// @brief The address of the instruction.
+        uint16_t pc;
+
+        /// @brief The immediate operand, if any.
+        uint16_t operand;
+
+        /// @brief The index of the instruction handler to execute.
+        ///
+        /// $000-$0FF for instructions, or $100-$1FF for CB-prefixed
+        /// instructions, in which case the prefix is already consumed.
+        uint16_t handler;
+
+        /// @brief The length of the instruction in bytes.
+        uint8_t length;
+
+        /// @brief The number of T-cycles taken to fetch the instruction.
+        uint8_t cycles;
+    };
+
+    /// @brief Defines native code compiled from consecutive instructions of a
+    /// block.
+    struct NativeRun
+    {
+        /// @brief Signature of the native code.
+        /// @param cpu The CPU to execute the instructions on.
+        /// @param registers The registers of `cpu`.
+        using Code = void (*)(CPU* cpu, void* registers);
+
+        /// @brief The native code, or `nullptr` if no run starts at this
+        /// instruction.
+        Code code;
+
+        /// @brief The number of instructions in the run.
+        uint16_t count;
+
+        /// @brief The number of T-cycles taken by the instructions.
+        uint16_t cycles;
+
+        /// @brief The address of the first instruction after the run.
+        uint16_t next_pc;
+    };
+
+    /// @brief Defines a run of straight-line code ending at a control
+    /// transfer instruction.
+    struct BasicBlock
+    {
+        /// @brief The instructions of the block, in program order.
+        std::vector<DecodedInstruction> instructions;
+
+        /// @brief The number of times the block has been entered.
+        unsigned int executions{ 0 };
+
+        /// @brief Native code for the block, indexed by the instruction each
+        /// run starts at. Empty if the block hasn't been recompiled.
+        std::vector<NativeRun> runs;
+    };
+
+    /// @brief Defines a cache of basic blocks decoded from ROM, WRAM and
+    /// HRAM.
+    ///
+    /// Blocks are keyed on the ROM bank and address they were decoded from,
+    /// so switching banks doesn't require decoding the same code again.
+    /// Blocks decoded from WRAM and HRAM are discarded as soon as the memory
+    /// they were decoded from is written to.
+    class BlockCache final
+    {
+    public:
+        /// @brief Initializes the block cache.
+        /// @param bus The current system bus instance.
+        explicit BlockCache(SystemBus& bus) noexcept;
+
+        /// @brief Discards all blocks.
+        auto clear() noexcept -> void;
+
+        /// @brief Discards all blocks decoded from WRAM and HRAM.
+        auto invalidate_ram() noexcept -> void;
+
+        /// @brief Returns the block starting at an address, decoding it first
+        /// if necessary.
+        /// @param pc The address of the block.
+        /// @return The block, or `nullptr` if code at `pc` can't be cached.
+        auto find(const uint16_t pc) noexcept -> BasicBlock*;
+
+    private:
+        /// @brief Decodes a block.
+        /// @param pc The address of the block.
+        /// @param end The first address after the memory region `pc` is in.
+        /// @return The decoded block, which may be empty.
+        auto decode(uint16_t pc, const unsigned int end) noexcept -> BasicBlock;
+
+        /// @brief Blocks decoded from ROM, keyed on `(bank << 16) | pc`.
+        std::unordered_map<uint32_t, BasicBlock> rom_blocks;
+
+        /// @brief Blocks decoded from WRAM and HRAM, keyed on the address.
+        std::unordered_map<uint16_t, BasicBlock> ram_blocks;
+
+        /// @brief System bus instance
+        SystemBus& m_bus;
+    };
+}
@@ -19,6 +19,7 @@
 #include <memory>
 #include <vector>
 #include "apu.h"
+#include "cow_memory.h"
 #include "ppu.h"
 #include "scheduler.h"
 #include "timer.h"
@@ -26,6 +27,7 @@
 namespace GameBoy
 {
     class Cartridge;
+    class StateSerializer;
 
     /// @brief Types of interrupts possible.
     enum Interrupt : unsigned int
@@ -78,9 +80,37 @@ namespace GameBoy
         /// memory.
         auto reset() noexcept -> void;
 
-        /// @brief Advances the devices by 1 m-cycle.
+        /// @brief Saves or loads the state of the bus, the devices and the
+        /// cartridge.
+        ///
+        /// The ROM and boot ROM are not part of the state, as they never
+        /// change.
+        /// @param state The save state serializer.
+        auto serialize(StateSerializer& state) noexcept -> void;
+
+        /// @brief Shares the memory of another bus until either writes to it,
+        /// and takes a copy of its cartridge and boot ROM, for a forked
+        /// system. The state of the devices is left untouched.
+        /// @param parent The bus to share the memory of.
+        auto share_memory(const SystemBus& parent) -> void;
+
+        /// @brief Advances the master clock by 1 m-cycle.
+        ///
+        /// The devices are not brought up to date until the next call to
+        /// `sync()`.
         auto step() noexcept -> void;
 
+        /// @brief Advances the master clock by a number of T-cycles.
+        ///
+        /// The devices are not brought up to date until the next call to
+        /// `sync()`.
+        /// @param count The number of T-cycles to advance by.
+        auto advance(const unsigned int count) noexcept -> void;
+
+        /// @brief Brings the devices up to date by dispatching all events
+        /// that are due.
+        auto sync() noexcept -> void;
+
         /// @brief Request an interrupt.
         /// @param interrupt The interrupt to request.
         auto irq(const Interrupt interrupt) noexcept -> void;
@@ -89,20 +119,45 @@ namespace GameBoy
         /// @param address The address to read from.
         /// @param type
         /// 
-        /// `AccessType::Emulated` (default): Steps the devices by 1 m-cycle.
+        /// `AccessType::Emulated` (default): Steps the devices by 1 m-cycle,
+        /// and brings them up to date if the address belongs to one of them.
         /// `AccessType::Direct`: Does not step the devices.
         /// @return The byte from memory.
         auto read(const uint16_t address,
                   const AccessType type = AccessType::Emulated) noexcept -> uint8_t;
 
-        /// @brief Stores a byte into memory.
+        /// @brief Stores a byte into memory, stepping the devices by 1 m-cycle
+        /// and bringing them up to date.
         /// @param address The address to write to.
         /// @param data The data to store at the address.
         auto write(const uint16_t address,
                    const uint8_t data) noexcept -> void;
 
+        /// @brief Returns the ROM bank currently mapped to $4000 - $7FFF.
+        /// @return The ROM bank.
+        auto rom_bank() noexcept -> unsigned int;
+
+        /// @brief Determines if the boot ROM is mapped to $0000 - $00FF.
+        /// @return `true` if the boot ROM is mapped, or `false` otherwise.
+        auto boot_rom_mapped() const noexcept -> bool;
+
+        /// @brief Determines if a cartridge is set.
+        /// @return `true` if a cartridge is set, or `false` otherwise.
+        auto has_cart() const noexcept -> bool;
+
+        /// @brief Returns the 16-byte chunk of WRAM or HRAM an address
+        /// belongs to.
+        /// @param address The address, which must be in WRAM or HRAM.
+        /// @return The index of the chunk in `code_chunks`.
+        static constexpr auto code_chunk(const uint16_t address) noexcept
+        -> unsigned int
+        {
+            return (address < 0xE000) ? (address - 0xC000) >> 4
+                                      : 512 + ((address - 0xFF80) >> 4);
+        }
+
         /// @brief [$C000 - $DFFF]: 4KB Work RAM Bank 0-1 (WRAM)
-        std::array<uint8_t, 8192> wram;
+        CowMemory<8192> wram;
 
         union
         {
@@ -138,22 +193,75 @@ namespace GameBoy
         /// @brief [$FF80 - $FFFE]: High RAM (HRAM)
         std::array<uint8_t, 127> hram;
 
+        /// @brief Scheduler instance
+        ///
+        /// This is declared before the devices, as they schedule events when
+        /// they are constructed.
+        Scheduler sched;
+
         /// @brief APU (audio processing unit) device instance
         APU apu;
 
         /// @brief PPU (picture processing unit) device instance
         PPU ppu;
 
-        /// @brief Scheduler instance
-        Scheduler sched;
-
         /// @brief Timer device instance
         Timer timer;
 
         // The number of cycles taken by the current step.
         unsigned int cycles;
 
+        /// @brief 16-byte chunks of WRAM and HRAM that cached code has been
+        /// decoded from.
+        std::array<bool, 520> code_chunks;
+
+        /// @brief Incremented whenever a chunk marked in `code_chunks` is
+        /// written to.
+        unsigned int ram_code_generation;
+
+        /// @brief Incremented whenever the memory mapped to $0000 - $7FFF may
+        /// have changed, i.e. a memory bank controller register was written
+        /// to or the boot ROM was unmapped.
+        unsigned int rom_generation;
+
+        /// @brief Incremented whenever an event is dispatched.
+        unsigned int events_dispatched;
+
     private:
+        /// @brief Returns a byte from the cartridge.
+        /// @param address The memory address to read from.
+        /// @return The byte from the cartridge.
+        auto cart_read(const uint16_t address) noexcept -> uint8_t;
+
+        /// @brief Updates the memory bank controller configuration.
+        /// @param address The configuration area to update.
+        /// @param data The value to update the area with.
+        auto cart_write(const uint16_t address,
+                        const uint8_t data) noexcept -> void;
+
+        /// @brief Points the page table at the memory currently mapped.
+        auto map_pages() noexcept -> void;
+
+        /// @brief The memory mapped to each 4KB page of the address space, for
+        /// reads. Pages set to `nullptr` are handled by `read()`: I/O, HRAM,
+        /// cartridge RAM and anything the boot ROM overlays. Writes always go
+        /// through `write()`.
+        std::array<const uint8_t*, 16> read_pages;
+
+        /// @brief Dispatches all events that are due to their devices.
+        auto dispatch_events() noexcept -> void;
+
+        /// @brief Notes a write to WRAM or HRAM, in case cached code was
+        /// decoded from the address.
+        /// @param address The address written to.
+        auto code_write(const uint16_t address) noexcept -> void;
+
+        /// @brief Copies the OAM DMA source page to OAM.
+        auto dma_transfer() noexcept -> void;
+
+        /// @brief The source address of the current OAM DMA transfer.
+        uint16_t dma_source;
+
         /// @brief Is the boot ROM disabled?
         /// 
         /// This only matters if the user has requested to use a boot ROM. It
@@ -15,15 +15,35 @@
 #pragma once
 
 #include <map>
+#include <memory>
 #include <string>
-#include <vector>
+#include "rom_image.h"
 
 namespace GameBoy
 {
+    class StateSerializer;
+
+    /// @brief The implementations of `Cartridge`.
+    enum class CartKind
+    {
+        /// @brief `ROMOnlyCartridge`
+        ROMOnly,
+
+        /// @brief `MBC1Cartridge`
+        MBC1,
+
+        /// @brief `MBC3Cartridge`
+        MBC3
+    };
+
     /// @brief Defines a game cartridge.
     class Cartridge
     {
     public:
+        /// @brief The implementation of this cartridge, which allows calls to
+        /// be resolved without going through the vtable.
+        const CartKind kind;
+
         /// @brief Returns a byte from the cartridge.
         /// @param address The memory address to read from.
         /// @return The byte from the cartridge.
@@ -35,6 +55,27 @@ namespace GameBoy
         virtual auto write(const uint16_t address,
                            const uint8_t data) -> void = 0;
 
+        /// @brief Returns the ROM bank currently mapped to $4000 - $7FFF.
+        /// @return The ROM bank.
+        virtual auto current_rom_bank() -> unsigned int = 0;
+
+        /// @brief Returns the ROM data currently mapped to a 4KB page of
+        /// $0000 - $7FFF, so that it can be read without calling `read()`.
+        /// @param page The page, from 0 ($0000 - $0FFF) to 7 ($7000 - $7FFF).
+        /// @return The data, or `nullptr` if it must be read through `read()`.
+        virtual auto rom_page(const unsigned int page) -> const uint8_t* = 0;
+
+        /// @brief Saves or loads the state of the memory bank controller and
+        /// the cartridge RAM.
+        /// @param state The save state serializer.
+        virtual auto serialize(StateSerializer& state) -> void = 0;
+
+        /// @brief Returns a copy of the cartridge, for a forked system. The
+        /// ROM image is shared, as is the cartridge RAM until either copy
+        /// writes to it.
+        /// @return The copy.
+        virtual auto clone() const -> std::shared_ptr<Cartridge> = 0;
+
         /// @brief Gets the title of the cartridge as specicfied in the data.
         /// @return The cartridge title.
         auto title() noexcept -> std::string
@@ -128,13 +169,25 @@ namespace GameBoy
         };
 
     protected:
-        explicit Cartridge
-        (const std::vector<uint8_t>& data) noexcept
+        explicit Cartridge(const std::shared_ptr<const RomImage>& rom,
+                           const CartKind cart_kind) noexcept :
+        kind(cart_kind), m_rom(rom), m_data(rom->data())
+        { }
+
+        /// @brief Returns 4KB of the cartridge data.
+        /// @param offset The offset of the data.
+        /// @return The data, or `nullptr` if the cartridge is too small.
+        auto data_page(const std::size_t offset) const noexcept
+        -> const uint8_t*
         {
-            m_data = data;
+            return ((offset + 0x1000) <= m_rom->size()) ? &m_data[offset]
+                                                        : nullptr;
         }
 
-        /// @brief The cartridge data.
-        std::vector<uint8_t> m_data;
+        /// @brief The ROM image, shared with every other cartridge using it.
+        std::shared_ptr<const RomImage> m_rom;
+
+        /// @brief The cartridge data, i.e. `m_rom->data()`.
+        const uint8_t* m_data;
     };
 }
\ No newline at end of file
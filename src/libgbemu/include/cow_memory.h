@@ -0,0 +1,179 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "state.h"
+
+namespace GameBoy
+{
+    /// @brief Defines a block of memory made of 4KB pages, which copies of it
+    /// share until one of them writes to a page.
+    ///
+    /// Copying the memory only copies the page pointers, so that a forked
+    /// system costs next to nothing until it diverges from its parent. A page
+    /// is copied the first time it is written to while shared, by whichever
+    /// copy writes to it first; the others keep the original.
+    ///
+    /// Copies may live on different threads, but each copy must only be used
+    /// by one thread at a time.
+    /// @tparam Size The size of the memory, a multiple of `PAGE_SIZE`.
+    template<std::size_t Size>
+    class CowMemory final
+    {
+    public:
+        /// @brief The size of a page, which matches the pages of
+        /// `SystemBus`.
+        static constexpr std::size_t PAGE_SIZE{ 0x1000 };
+
+        /// @brief The number of pages.
+        static constexpr std::size_t PAGES{ Size / PAGE_SIZE };
+
+        static_assert((Size % PAGE_SIZE) == 0,
+                      "the size must be a multiple of the page size");
+
+        /// @brief Initializes the memory, cleared to 0.
+        CowMemory() noexcept
+        {
+            for (std::size_t page{ 0 }; page < PAGES; ++page)
+            {
+                m_pages[page] = std::make_shared<Page>();
+                m_data[page] = m_pages[page]->data();
+            }
+        }
+
+        /// @brief Returns the size of the memory.
+        /// @return The size of the memory, in bytes.
+        static constexpr auto size() noexcept -> std::size_t
+        {
+            return Size;
+        }
+
+        /// @brief Returns a byte from memory.
+        /// @param index The offset of the byte.
+        /// @return The byte.
+        auto operator[](const std::size_t index) const noexcept -> uint8_t
+        {
+            assert(index < Size);
+            return m_data[index / PAGE_SIZE][index % PAGE_SIZE];
+        }
+
+        /// @brief Stores a byte into memory, copying its page first if it is
+        /// shared.
+        /// @param index The offset of the byte.
+        /// @param data The byte to store.
+        auto write(const std::size_t index, const uint8_t data) noexcept -> void
+        {
+            assert(index < Size);
+            writable_page(index / PAGE_SIZE)[index % PAGE_SIZE] = data;
+        }
+
+        /// @brief Returns the data of a page, for reads only.
+        ///
+        /// The pointer remains valid until the page is written to through
+        /// `writable_page()`, `write()` or `clear()`.
+        /// @param page The page.
+        /// @return The data.
+        auto page(const std::size_t page) const noexcept -> const uint8_t*
+        {
+            return m_data[page];
+        }
+
+        /// @brief Determines if a page is shared with a copy of the memory.
+        /// @param page The page.
+        /// @return `true` if the page is shared, or `false` otherwise.
+        auto shared(const std::size_t page) const noexcept -> bool
+        {
+            return m_pages[page].use_count() > 1;
+        }
+
+        /// @brief Returns the data of a page for writes, copying it first if
+        /// it is shared.
+        /// @param page The page.
+        /// @return The data, which remains valid until the memory is copied.
+        auto writable_page(const std::size_t page) noexcept -> uint8_t*
+        {
+            if (shared(page))
+            {
+                m_pages[page] = std::make_shared<Page>(*m_pages[page]);
+                m_data[page] = m_pages[page]->data();
+            }
+            else
+            {
+                // The last copy sharing the page may have just let go of it
+                // on another thread, after reading it.
+                std::atomic_thread_fence(std::memory_order_acquire);
+            }
+            return m_data[page];
+        }
+
+        /// @brief Clears the memory to 0. Shared pages are replaced rather
+        /// than copied.
+        auto clear() noexcept -> void
+        {
+            for (std::size_t page{ 0 }; page < PAGES; ++page)
+            {
+                if (shared(page))
+                {
+                    m_pages[page] = std::make_shared<Page>();
+                    m_data[page] = m_pages[page]->data();
+                }
+                else
+                {
+                    m_pages[page]->fill(0x00);
+                }
+            }
+        }
+
+        /// @brief Saves or loads the memory, as one contiguous block.
+        ///
+        /// Nothing is done if the serializer leaves out memory, i.e. when the
+        /// memory of a forked system is shared instead.
+        /// @param state The save state serializer.
+        auto serialize(StateSerializer& state) noexcept -> void
+        {
+            if (!state.memory())
+            {
+                return;
+            }
+
+            for (std::size_t page{ 0 }; page < PAGES; ++page)
+            {
+                // Only loading writes to the data.
+                state.bytes(state.loading() ? writable_page(page)
+                                            : m_data[page],
+                            PAGE_SIZE);
+            }
+        }
+
+    private:
+        /// @brief Defines a page.
+        using Page = std::array<uint8_t, PAGE_SIZE>;
+
+        /// @brief The pages, shared with every copy of the memory that didn't
+        /// write to them since.
+        std::array<std::shared_ptr<Page>, PAGES> m_pages;
+
+        /// @brief The data of each page, i.e. `m_pages[page]->data()`, kept
+        /// here to spare reads from going through the control block.
+        std::array<uint8_t*, PAGES> m_data;
+    };
+}
@@ -14,14 +14,37 @@
 
 #pragma once
 
+#include <array>
 #include <cstdint>
-#include <functional>
+#include <memory>
+#include <utility>
+#include "block_cache.h"
+#include "idle_loop.h"
 
 namespace GameBoy
 {
+    class Recompiler;
+    class StateSerializer;
     class SystemBus;
 
-    using ALUFunc = std::function<uint8_t(uint8_t)>;
+    /// @brief Ways the CPU can execute instructions.
+    enum class ExecutionMode
+    {
+        /// @brief Every instruction is fetched and decoded as it is executed.
+        /// This is the default.
+        Interpreter,
+
+        /// @brief Instructions are decoded into basic blocks once, and
+        /// executed from the block cache from then on.
+        CachedInterpreter,
+
+        /// @brief As `CachedInterpreter`, but frequently executed blocks are
+        /// also recompiled to native code where possible.
+        ///
+        /// This is the same as `CachedInterpreter` if the recompiler was not
+        /// built in (`GBEMU_JIT`).
+        Recompiler
+    };
 
     /// @brief Defines a Sharp SM83 CPU interpreter.
     class CPU final
@@ -34,6 +57,13 @@ namespace GameBoy
         /// @brief Resets the CPU to the startup state.
         auto reset() noexcept -> void;
 
+        /// @brief Saves or loads the state of the CPU.
+        ///
+        /// Only the architectural state is saved. Anything derived from
+        /// memory, such as decoded blocks, is discarded when loading.
+        /// @param state The save state serializer.
+        auto serialize(StateSerializer& state) noexcept -> void;
+
         /// @brief Executes the next instruction.
         auto step() noexcept -> void;
 
@@ -130,12 +160,176 @@ namespace GameBoy
             Normal
         };
 
+        /// @brief Returns the value of the Flag (F) register.
+        ///
+        /// With lazy flag evaluation (`GBEMU_LAZY_FLAGS`), `reg.f` may be out
+        /// of date, so this must be used instead of reading it directly.
+        /// @return The value of the Flag (F) register.
+        auto flags() const noexcept -> uint8_t;
+
+        /// @brief Brings `reg.f` up to date with any flags still pending from
+        /// the last arithmetic instruction.
+        auto sync_flags() noexcept -> void;
+
         /// @brief Interrupt Master Enable Flag
         bool ime;
 
         bool halted;
 
+        /// @brief How instructions are executed.
+        ExecutionMode mode;
+
+        /// @brief Skips loops waiting on an event, if enabled.
+        IdleLoopDetector idle_loops;
+
     private:
+        /// @brief Arithmetic instructions whose flags can be left pending.
+        enum class FlagOperation : uint8_t
+        {
+            /// @brief No flags are pending, `reg.f` is up to date.
+            None,
+
+            /// @brief ADD, ADC
+            Add,
+
+            /// @brief SUB, SBC, CP
+            Subtract,
+
+            /// @brief INC r
+            Increment,
+
+            /// @brief DEC r
+            Decrement
+        };
+
+        /// @brief Defines the operands and result of the last arithmetic
+        /// instruction, from which the flags are evaluated when read.
+        struct PendingFlags
+        {
+            /// @brief The instruction the flags are pending from.
+            FlagOperation operation;
+
+            /// @brief ADD, SUB: The Accumulator before the operation.
+            unsigned int lhs;
+
+            /// @brief ADD, SUB: The operand.
+            /// INC, DEC: The Carry flag, which is left untouched.
+            unsigned int rhs;
+
+            /// @brief The result of the operation, before truncating it to
+            /// 8 bits.
+            unsigned int result;
+        };
+
+        /// @brief Returns the Carry flag.
+        /// @return `true` if the Carry flag is set, or `false` otherwise.
+        auto carry() const noexcept -> bool;
+
+        /// @brief Executes the next instruction from the block cache, falling
+        /// back to the interpreter if it can't be cached.
+        auto step_cached() noexcept -> void;
+
+        /// @brief Returns the number of T-cycles the CPU stays halted for
+        /// before the next event is dispatched.
+        /// @return The number of T-cycles, rounded up to a whole m-cycle and
+        /// at most `MAX_HALT_CYCLES`.
+        auto halt_cycles() const noexcept -> unsigned int;
+
+        /// @brief Executes native code for the instructions starting at the
+        /// current position in `block`, if there is any and no event becomes
+        /// due while it runs.
+        /// @return `true` if native code was executed, or `false` otherwise.
+        auto step_native() noexcept -> bool;
+
+        /// @brief Recompiles `block`, starting over with an empty block cache
+        /// if the code buffer is full.
+        auto recompile() noexcept -> void;
+
+        friend class Recompiler;
+
+        /// @brief Signature of an instruction handler in the dispatch table.
+        using Handler = void (*)(CPU& cpu) noexcept;
+
+        /// @brief Executes an instruction using the dispatch backend selected
+        /// at build time.
+        /// @param instruction The opcode of the instruction to execute.
+        auto dispatch(const uint8_t instruction) noexcept -> void;
+
+        /// @brief Executes a CB-prefixed instruction using the dispatch
+        /// backend selected at build time.
+        /// @param instruction The opcode following the $CB prefix.
+        auto dispatch_cb(const uint8_t instruction) noexcept -> void;
+
+        /// @brief Executes an instruction decoded at compile time.
+        /// @tparam Opcode The opcode of the instruction.
+        template<uint8_t Opcode>
+        auto execute() noexcept -> void;
+
+        /// @brief Executes a CB-prefixed instruction decoded at compile time.
+        /// @tparam Opcode The opcode following the $CB prefix.
+        template<uint8_t Opcode>
+        auto execute_cb() noexcept -> void;
+
+        /// @brief Dispatch table entry for an instruction.
+        /// @tparam Index $000-$0FF for instructions, or $100-$1FF for
+        /// CB-prefixed instructions.
+        /// @param cpu The CPU to execute the instruction on.
+        template<unsigned int Index>
+        static auto handler(CPU& cpu) noexcept -> void;
+
+        /// @brief Generates the dispatch table.
+        /// @return The dispatch table.
+        template<std::size_t... Index>
+        static constexpr auto make_handlers(std::index_sequence<Index...>)
+        noexcept -> std::array<Handler, sizeof...(Index)>;
+
+        /// @brief Handlers for all 256 instructions, followed by all 256
+        /// CB-prefixed instructions.
+        static const std::array<Handler, 512> handlers;
+
+        /// @brief Returns the value of an 8-bit operand.
+        /// @tparam Index The operand as encoded in an opcode:
+        /// B, C, D, E, H, L, (HL), A.
+        /// @return The value of the operand.
+        template<unsigned int Index>
+        auto get_r8() noexcept -> uint8_t;
+
+        /// @brief Stores a value into an 8-bit operand.
+        /// @tparam Index The operand as encoded in an opcode:
+        /// B, C, D, E, H, L, (HL), A.
+        /// @param data The value to store.
+        template<unsigned int Index>
+        auto set_r8(const uint8_t data) noexcept -> void;
+
+        /// @brief Returns a register pair.
+        /// @tparam Index The register pair as encoded in an opcode:
+        /// BC, DE, HL, SP.
+        /// @return The register pair.
+        template<unsigned int Index>
+        auto r16() noexcept -> uint16_t&;
+
+        /// @brief Evaluates a branch condition.
+        /// @tparam Index The condition as encoded in an opcode:
+        /// NZ, Z, NC, C.
+        /// @return `true` if the condition is met, or `false` otherwise.
+        template<unsigned int Index>
+        auto condition() const noexcept -> bool;
+
+        /// @brief Performs an ALU operation on the Accumulator (register A).
+        /// @tparam Operation The operation as encoded in an opcode:
+        /// ADD, ADC, SUB, SBC, AND, XOR, OR, CP.
+        /// @param n The operand.
+        template<unsigned int Operation>
+        auto alu(const uint8_t n) noexcept -> void;
+
+        /// @brief Performs a CB-prefixed rotate or shift operation.
+        /// @tparam Operation The operation as encoded in an opcode:
+        /// RLC, RRC, RL, RR, SLA, SRA, SWAP, SRL.
+        /// @param n The value to rotate or shift.
+        /// @return The rotated or shifted value.
+        template<unsigned int Operation>
+        auto rotate(const uint8_t n) noexcept -> uint8_t;
+
         /// @brief Returns a byte from memory using the program counter as a
         /// memory address, then increments the program counter.
         /// @return The byte from memory.
@@ -187,7 +381,8 @@ namespace GameBoy
         /// operation back into memory using register pair HL as a memory
         /// address.
         /// @param f The function to call.
-        auto rw_hl(const ALUFunc& f) noexcept -> void;
+        template<class Function>
+        auto rw_hl(const Function f) noexcept -> void;
 
         /// @brief Performs a bitwise operation between the Accumulator
         /// (register A) and a value, sets the Flag register (F) based on
@@ -340,6 +535,18 @@ namespace GameBoy
         /// @return The shifted value.
         auto srl(uint8_t n) noexcept -> uint8_t;
 
+        /// @brief Handles the DAA instruction.
+        auto daa() noexcept -> void;
+
+        /// @brief Handles the CPL instruction.
+        auto cpl() noexcept -> void;
+
+        /// @brief Handles the SCF instruction.
+        auto scf() noexcept -> void;
+
+        /// @brief Handles the CCF instruction.
+        auto ccf() noexcept -> void;
+
         /// @brief Handles the BIT instruction.
         /// @param b The bit to test.
         /// @param n The value to test `b` against.
@@ -355,6 +562,45 @@ namespace GameBoy
         auto bit_hl(const Operator op,
                     const unsigned int bit) noexcept -> void;
 
+        /// @brief Decoded basic blocks, used by
+        /// `ExecutionMode::CachedInterpreter`.
+        BlockCache cache;
+
+        /// @brief The block the previous instruction was executed from, if
+        /// any.
+        BasicBlock* block;
+
+        /// @brief The index of the next instruction in `block`.
+        std::size_t block_index;
+
+        /// @brief The value of `SystemBus::ram_code_generation` the block
+        /// cache is up to date with.
+        unsigned int ram_code_generation;
+
+        /// @brief The value of `SystemBus::rom_generation` `block` was
+        /// looked up with.
+        unsigned int rom_generation;
+
+        /// @brief Is a decoded instruction being executed?
+        ///
+        /// If so, `read_next_byte()` returns the bytes of `operand` instead of
+        /// reading them from memory, as the fetch has already been accounted
+        /// for.
+        bool predecoded;
+
+        /// @brief The remaining immediate operand of the decoded instruction
+        /// being executed.
+        uint16_t operand;
+
+        /// @brief Flags not yet stored in `reg.f`, used by lazy flag
+        /// evaluation (`GBEMU_LAZY_FLAGS`).
+        PendingFlags pending_flags;
+
+        /// @brief Recompiler instance, used by `ExecutionMode::Recompiler`.
+        ///
+        /// This is `nullptr` if the recompiler was not built in.
+        std::shared_ptr<Recompiler> jit;
+
         /// @brief System bus instance
         SystemBus& m_bus;
     };
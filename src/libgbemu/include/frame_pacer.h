@@ -0,0 +1,122 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "gb.h"
+
+namespace GameBoy
+{
+    /// @brief Defines a pacer which holds a run loop to the frame rate of the
+    /// system, for frontends presenting the frames as they're emulated.
+    ///
+    /// Frames are due at absolute deadlines, one period apart, so that the
+    /// time taken to emulate and present a frame never adds up into drift.
+    /// The pacer sleeps until shortly before the deadline and spins for the
+    /// rest, since sleeps routinely overshoot by tens to hundreds of
+    /// microseconds.
+    ///
+    /// The time between frames is recorded in a histogram, to verify how
+    /// steady the frame rate is.
+    class FramePacer final
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /// @brief The time the LCD takes to draw a frame, about 16.743 ms
+        /// (59.73 Hz).
+        static constexpr std::chrono::nanoseconds FRAME_PERIOD
+        {
+            (System::CYCLES_PER_FRAME * 1000000000ULL) / 4194304
+        };
+
+        /// @brief The time spent spinning, rather than sleeping, before a
+        /// deadline.
+        static constexpr std::chrono::microseconds SPIN_TIME{ 1000 };
+
+        /// @brief The width of a bucket of the histogram.
+        static constexpr std::chrono::microseconds BUCKET_WIDTH{ 100 };
+
+        /// @brief The number of buckets in the histogram, covering 0 - 40 ms.
+        /// Longer frames land in the last bucket.
+        static constexpr std::size_t BUCKETS{ 400 };
+
+        /// @brief Initializes a frame pacer.
+        /// @param period The time between frames.
+        explicit FramePacer(const Clock::duration period = FRAME_PERIOD)
+        noexcept;
+
+        /// @brief Schedules the next frame a period from now, i.e. when the
+        /// run loop starts or resumes. The histogram is left untouched.
+        auto reset() noexcept -> void;
+
+        /// @brief Waits until the next frame is due.
+        ///
+        /// If the frame is already late by more than a period, the frames
+        /// missed are skipped over rather than rushed through to catch up.
+        auto wait() noexcept -> void;
+
+        /// @brief Clears the histogram and the statistics.
+        auto clear() noexcept -> void;
+
+        /// @brief Returns the histogram of the time between frames.
+        /// @return The number of frames in each bucket of `BUCKET_WIDTH`.
+        auto histogram() const noexcept
+        -> const std::array<uint64_t, BUCKETS>&;
+
+        /// @brief Formats the statistics and the histogram for display.
+        /// @return The report, one line per nonempty bucket after a summary.
+        auto report() const -> std::string;
+
+    private:
+        /// @brief The time between frames.
+        Clock::duration m_period;
+
+        /// @brief The time the next frame is due at.
+        Clock::time_point m_deadline;
+
+        /// @brief The time the previous call to `wait()` returned at, if
+        /// `m_has_previous` is set.
+        Clock::time_point m_previous;
+
+        /// @brief Has a frame been waited for since the last reset?
+        bool m_has_previous;
+
+        /// @brief The time between frames, in buckets of `BUCKET_WIDTH`.
+        std::array<uint64_t, BUCKETS> m_histogram;
+
+        /// @brief The number of frames in the histogram.
+        uint64_t m_frames;
+
+        /// @brief The number of frames that were already due when waited for.
+        uint64_t m_late;
+
+        /// @brief The sum of the time between frames, in seconds.
+        double m_sum;
+
+        /// @brief The sum of the squares of the time between frames.
+        double m_sum_squares;
+
+        /// @brief The shortest time between frames, in seconds.
+        double m_min;
+
+        /// @brief The longest time between frames, in seconds.
+        double m_max;
+    };
+}
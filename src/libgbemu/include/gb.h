@@ -14,11 +14,15 @@
 
 #pragma once
 
+#include <memory>
 #include "bus.h"
 #include "cpu.h"
+#include "rom_image.h"
 
 namespace GameBoy
 {
+    class StateSerializer;
+
     /// @brief Defines a Game Boy system.
     class System
     {
@@ -46,11 +50,25 @@ namespace GameBoy
         /// * The ROM requires a memory bank controller we don't support.
         /// 
         /// @param cart_data The data to use to generate the Cartridge
-        /// instance.
+        /// instance. It is copied into a ROM image of its own.
         /// @return The generated cartridge.
         auto cart(const std::vector<uint8_t>& cart_data) ->
         std::shared_ptr<Cartridge>;
 
+        /// @brief Generates a cartridge referencing a ROM image, without
+        /// copying it.
+        /// 
+        /// This function will throw an `std::runtime_error` under the
+        /// following circumstances:
+        /// 
+        /// * The header checksum verification failed, or;
+        /// * The ROM requires a memory bank controller we don't support.
+        /// 
+        /// @param rom The ROM image to use to generate the Cartridge instance.
+        /// @return The generated cartridge.
+        auto cart(const std::shared_ptr<const RomImage>& rom) ->
+        std::shared_ptr<Cartridge>;
+
         /// @brief Sets the boot ROM data.
         /// @param data If `data` is not empty, a boot ROM is considered to be
         /// present. Otherwise, boot ROM functionality will be disabled.
@@ -60,10 +78,107 @@ namespace GameBoy
         /// @return The number of T-cycles taken by the current step.
         auto step() noexcept -> unsigned int;
 
+        /// @brief The number of T-cycles the LCD takes to draw a frame.
+        static constexpr unsigned int CYCLES_PER_FRAME{ 70224 };
+
+        /// @brief Executes steps until a frame's worth of T-cycles has
+        /// elapsed.
+        ///
+        /// The last step usually overshoots the end of the frame, and the
+        /// excess is taken off the next frame, so that frames keep in step
+        /// with the LCD over time.
+        /// @return The number of T-cycles taken by the steps executed.
+        auto run_frame() noexcept -> unsigned int;
+
+        /// @brief Sets which frames are rendered, i.e. to skip rendering when
+        /// only some frames are looked at. Changes take effect from the next
+        /// frame on.
+        /// @param policy The render policy.
+        /// @param interval With `RenderPolicy::EveryNth`, one frame out of
+        /// this many is rendered.
+        auto render_policy(const RenderPolicy policy,
+                           const unsigned int interval = 1) noexcept -> void;
+
+        /// @brief Requests the next frame to be rendered, with
+        /// `RenderPolicy::OnRequest`.
+        auto request_frame() noexcept -> void;
+
+        /// @brief The version of the save state format, incremented whenever
+        /// the state of a device changes.
+        static constexpr uint32_t STATE_VERSION{ 3 };
+
+        /// @brief Returns the size of a save state of the system, which
+        /// depends on the cartridge.
+        /// @return The size of a save state, in bytes.
+        auto state_size() noexcept -> std::size_t;
+
+        /// @brief Saves the state of the system to a buffer, without
+        /// allocating any memory.
+        ///
+        /// The state is a flat binary image of every device, preceded by a
+        /// header identifying the format and the cartridge. The frame being
+        /// rendered is not part of it.
+        /// @param data The buffer to save the state to.
+        /// @param size The size of the buffer, which must be at least
+        /// `state_size()`.
+        /// @return The size of the state, or 0 if the buffer is too small.
+        auto save_state(uint8_t* data, const std::size_t size) noexcept
+        -> std::size_t;
+
+        /// @brief Loads a state saved by `save_state()`, without allocating
+        /// any memory.
+        /// @param data The buffer to load the state from.
+        /// @param size The size of the buffer.
+        /// @return `true` if the state was loaded, or `false` if it is
+        /// truncated, of a different version or for a different cartridge,
+        /// in which case the system is left untouched.
+        auto load_state(const uint8_t* data, const std::size_t size) noexcept
+        -> bool;
+
+        /// @brief Forks the system, i.e. for a tree search.
+        ///
+        /// The child starts out in the exact state of this system, and runs
+        /// independently of it from then on. WRAM, VRAM and cartridge RAM are
+        /// shared between the two until either writes to a 4KB page of them,
+        /// which is copied then, and the ROM image is shared for good, so that
+        /// forking takes microseconds. The frame being rendered is not copied,
+        /// and the child decodes or recompiles code afresh.
+        /// @return The child.
+        auto fork() -> std::unique_ptr<System>;
+
         /// @brief System bus instance
         SystemBus bus;
 
         /// @brief Sharp SM83 CPU interpreter instance
         CPU cpu;
+
+        /// @brief The number of T-cycles executed into the current frame.
+        unsigned int frame_cycles;
+
+    private:
+        /// @brief Defines the header of a save state.
+        struct StateHeader
+        {
+            /// @brief Always `STATE_MAGIC`.
+            uint32_t magic;
+
+            /// @brief `STATE_VERSION` at the time the state was saved.
+            uint32_t version;
+
+            /// @brief Identifies the cartridge the state was saved with, or 0 if
+            /// there was none.
+            uint32_t cart_id;
+        };
+
+        /// @brief Identifies save states: "GBST" in little endian.
+        static constexpr uint32_t STATE_MAGIC{ 0x54534247 };
+
+        /// @brief Returns the header a state of the system is saved with.
+        /// @return The header.
+        auto state_header() noexcept -> StateHeader;
+
+        /// @brief Saves or loads the state of every device.
+        /// @param state The save state serializer.
+        auto serialize(StateSerializer& state) noexcept -> void;
     };
 }
\ No newline at end of file
@@ -0,0 +1,122 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace GameBoy
+{
+    class CPU;
+    class SystemBus;
+
+    /// @brief Defines a detector for loops that busy-wait on memory only an
+    /// event can change, such as polling LY or a flag set by an interrupt
+    /// handler.
+    ///
+    /// A loop is skipped once it has run a full iteration that left the
+    /// registers unchanged, and no event was dispatched in the meantime. Every
+    /// following iteration would then do exactly the same thing up until the
+    /// next event, so the system is advanced by as many whole iterations as
+    /// fit before it instead.
+    class IdleLoopDetector final
+    {
+    public:
+        /// @brief Initializes the detector.
+        /// @param bus The system bus the loops read from.
+        explicit IdleLoopDetector(SystemBus& bus) noexcept;
+
+        /// @brief Resets the detector and its counters to the startup state.
+        auto reset() noexcept -> void;
+
+        /// @brief Stops watching the current loop, i.e. because the state of
+        /// the system was replaced. The counters are left untouched.
+        auto forget() noexcept -> void;
+
+        /// @brief Checks the instruction the CPU is about to execute.
+        /// @param cpu The CPU instance.
+        /// @return The number of T-cycles to advance the system by before
+        /// executing the instruction, 0 if it isn't the start of an idle loop.
+        auto check(const CPU& cpu) noexcept -> unsigned int;
+
+        /// @brief Is idle loop detection enabled? Disabled by default.
+        bool enabled;
+
+        /// @brief The number of times an idle loop was skipped since the
+        /// cartridge was loaded.
+        uint64_t hits;
+
+        /// @brief The number of T-cycles skipped since the cartridge was
+        /// loaded.
+        uint64_t cycles_skipped;
+
+    private:
+        /// @brief The registers compared between iterations: AF, BC, DE, HL
+        /// and SP.
+        using Registers = std::array<uint16_t, 5>;
+
+        /// @brief Determines if the current loop can be skipped, based on its
+        /// instructions alone.
+        /// @param hl The value of register pair HL throughout the loop.
+        /// @return `true` if the loop neither writes to memory nor reads from
+        /// memory an instruction could change, or `false` otherwise.
+        auto analyze(const uint16_t hl) const noexcept -> bool;
+
+        /// @brief Determines if memory at an address can only change when an
+        /// event is dispatched or the CPU writes to it.
+        /// @param address The address to check.
+        /// @return `true` if the memory is stable, or `false` otherwise.
+        static auto stable(const uint16_t address) noexcept -> bool;
+
+        /// @brief The address of the previous instruction.
+        uint16_t previous_pc;
+
+        /// @brief The loop being watched, the last backward branch taken.
+        struct
+        {
+            /// @brief The address of the first instruction.
+            uint16_t head;
+
+            /// @brief The address of the branch back to `head`.
+            uint16_t branch;
+        } loop;
+
+        /// @brief The state of the system the last time `loop.head` was
+        /// reached through `loop.branch`.
+        struct
+        {
+            /// @brief Is the state valid?
+            bool valid;
+
+            /// @brief The result of `analyze()`.
+            bool idle;
+
+            /// @brief The registers.
+            Registers registers;
+
+            /// @brief The value of the master cycle counter.
+            uint64_t timestamp;
+
+            /// @brief The value of `SystemBus::events_dispatched`.
+            unsigned int events;
+
+            /// @brief The value of `SystemBus::rom_generation`.
+            unsigned int rom_generation;
+        } visit;
+
+        /// @brief System bus instance
+        SystemBus& m_bus;
+    };
+}
@@ -15,11 +15,13 @@
 #pragma once
 
 #include <array>
+#include <bitset>
 #include <cstdint>
-#include <vector>
+#include "cow_memory.h"
 
 namespace GameBoy
 {
+    class StateSerializer;
     class SystemBus;
 
     /// @brief The maximum length of a line.
@@ -31,6 +33,29 @@ namespace GameBoy
     /// @brief Alias for the screen data.
     using ScreenData = std::array<uint32_t, SCREEN_X * SCREEN_Y>;
 
+    /// @brief Alias for the color numbers of a scanline.
+    using LineNumbers = std::array<uint8_t, SCREEN_X>;
+
+    /// @brief Defines which frames the PPU renders.
+    ///
+    /// Frames that aren't rendered leave the framebuffer untouched, but the
+    /// modes, LY, STAT and the interrupts advance exactly as they otherwise
+    /// would.
+    enum class RenderPolicy
+    {
+        /// @brief Render every frame.
+        All,
+
+        /// @brief Render one frame out of every `PPU::render_interval`.
+        EveryNth,
+
+        /// @brief Render the frames requested with `PPU::request_frame()`.
+        OnRequest,
+
+        /// @brief Never render.
+        Never
+    };
+
     /// @brief Defines the picture processing unit (PPU).
     class PPU final
     {
@@ -50,8 +75,35 @@ namespace GameBoy
         /// @brief Resets the PPU to the startup state.
         auto reset() noexcept -> void;
 
-        /// @brief Advances the PPU by 1 m-cycle.
-        auto step() noexcept -> void;
+        /// @brief Saves or loads the state of the PPU.
+        ///
+        /// The frame being rendered is output for the host, and isn't part of
+        /// the state.
+        /// @param state The save state serializer.
+        auto serialize(StateSerializer& state) noexcept -> void;
+
+        /// @brief Updates STAT, leaving the read-only mode bits intact.
+        /// @param data The new STAT value.
+        auto set_STAT(const uint8_t data) noexcept -> void;
+
+        /// @brief Advances the scanline state machine to the next mode.
+        /// @param timestamp The timestamp the current mode ended at.
+        auto step(const uint64_t timestamp) noexcept -> void;
+
+        /// @brief Requests the next frame to be rendered, with
+        /// `RenderPolicy::OnRequest`. The frame being drawn is left as is.
+        auto request_frame() noexcept -> void;
+
+        /// @brief Stores a byte into VRAM, marking the tile it belongs to as
+        /// changed.
+        /// @param address The absolute memory address.
+        /// @param data The data to store at the address.
+        auto vram_write(const uint16_t address, const uint8_t data) noexcept
+        -> void;
+
+        /// @brief Marks every tile as changed, i.e. because VRAM was replaced
+        /// without going through `vram_write()`.
+        auto vram_changed() noexcept -> void;
 
         /// @brief Scroll Y
         //
@@ -150,21 +202,51 @@ namespace GameBoy
         uint8_t WX;
 
         // [$8000 - $9FFF] - 8KB Video RAM (VRAM)
-        std::array<uint8_t, 8192> vram;
+        CowMemory<8192> vram;
 
         // [$FE00 - $FE9F]: Sprite Attribute Table (OAM)
         std::array<uint8_t, 160> oam;
 
-        /// @brief Addresses of OAM entries that we must render
-        std::vector<uint16_t> oam_entries;
-
         /// @brief Screen data to be displayed to the host machine (RGBA32)
         ScreenData screen_data;
 
-        /// @brief The cycle counter for the scanline state machine.
-        unsigned int ly_counter;
+        /// @brief Where frames are rendered to, `screen_data` by default.
+        ///
+        /// Pointing it elsewhere lets the host have frames rendered straight
+        /// into memory of its own; `screen_data` is left untouched then.
+        ScreenData* framebuffer;
+
+        /// @brief Which frames are rendered, all of them by default. Changes
+        /// take effect from the next frame on.
+        RenderPolicy render_policy;
+
+        /// @brief With `RenderPolicy::EveryNth`, one frame out of this many
+        /// is rendered.
+        unsigned int render_interval;
+
+        /// @brief Defines where the render policy is at.
+        struct RenderProgress
+        {
+            /// @brief Is the frame being drawn rendered?
+            bool rendering;
+
+            /// @brief The number of frames started since the last one
+            /// rendered, with `RenderPolicy::EveryNth`.
+            unsigned int frames_skipped;
+
+            /// @brief Was a frame requested with `request_frame()`?
+            bool frame_requested;
+        };
+
+        /// @brief Where the render policy is at. Like the policy itself, this
+        /// isn't part of save states, so hosts that load a state to run frames
+        /// again must restore it themselves.
+        RenderProgress render_progress;
 
     private:
+        /// @brief Decides whether or not the frame starting is rendered.
+        auto begin_frame() noexcept -> void;
+
         /// @brief Returns a byte from VRAM using an absolute memory address.
         /// @param index The absolute memory address.
         /// @return The byte from VRAM.
@@ -175,20 +257,53 @@ namespace GameBoy
         /// @return The byte from OAM.
         auto oam_access(const unsigned int index) noexcept -> uint8_t;
 
+        /// @brief Alias for the colors of a palette, indexed by color number.
+        using PaletteColors = std::array<uint32_t, 4>;
+
+        /// @brief Returns the colors a palette assigns to the color numbers.
+        /// @param palette The palette to translate.
+        /// @return The colors.
+        static auto palette_colors(const Palette palette) noexcept
+        -> PaletteColors;
+
+        /// @brief Decodes a tile to color numbers.
+        /// @param tile The tile number, counting from $8000.
+        auto decode_tile(const unsigned int tile) noexcept -> void;
+
+        /// @brief Returns a decoded row of tile data, decoding the tile first
+        /// if it was changed since.
+        /// @param tile The tile number, counting from $8000.
+        /// @param row The row of the tile. Rows past the 8th continue into the
+        /// following tiles, as 8x16 sprites do.
+        /// @return The color numbers of the pixels, from left to right.
+        auto tile_row(const unsigned int tile, const unsigned int row) noexcept
+        -> const std::array<uint8_t, 8>&;
+
         /// @brief Renders the current scanline.
         auto draw_scanline() noexcept -> void;
 
-        /// @brief Puts a pixel on the screen data.
-        /// @param lo The low byte of the tile data.
-        /// @param hi The high byte of the tile data.
-        /// @param bit The pixel bit to use.
-        /// @param palette The palette to use for color translation.
-        /// @param sprite Ignore color 0 if `true`.
-        auto pixel(const uint8_t hi,
-                   const uint8_t lo,
-                   const unsigned int bit,
-                   const Palette palette,
-                   const bool sprite) noexcept -> void;
+        /// @brief Renders a part of the current scanline from a tile map.
+        /// @param line The pixels of the current scanline.
+        /// @param numbers Receives the color numbers of the pixels.
+        /// @param begin The first pixel to render.
+        /// @param end One past the last pixel to render.
+        /// @param tile_map The beginning address of the tile map.
+        /// @param x The X position in the tile map of the first pixel.
+        /// @param y The Y position in the tile map of the scanline.
+        auto draw_tiles(uint32_t* const line,
+                        LineNumbers& numbers,
+                        const unsigned int begin,
+                        const unsigned int end,
+                        const uint16_t tile_map,
+                        unsigned int x,
+                        const unsigned int y) noexcept -> void;
+
+        /// @brief Renders the sprites found for the current scanline.
+        /// @param line The pixels of the current scanline.
+        /// @param bg_numbers The color numbers of the background and window
+        /// pixels, which sprites can be drawn behind.
+        auto draw_sprites(uint32_t* const line,
+                          const LineNumbers& bg_numbers) noexcept -> void;
 
         /// @brief LCD Control
         union
@@ -225,9 +340,6 @@ namespace GameBoy
             uint8_t byte;
         } LCDC;
 
-        /// @brief Current X position of the scanline being drawn.
-        unsigned int screen_x;
-
         // @brief RGBA32 color values used for the screen data.
         enum Colors : uint32_t
         {
@@ -237,6 +349,17 @@ namespace GameBoy
             Black     = 0x00000000
         };
 
+        /// @brief The maximum number of sprites drawn on a line.
+        static constexpr auto MAX_SPRITES_PER_LINE{ 10 };
+
+        /// @brief Addresses of the OAM entries of the sprites found on the
+        /// current line, by priority: the sprite with the lowest X position
+        /// first, and the one earlier in OAM if they're the same.
+        std::array<uint16_t, MAX_SPRITES_PER_LINE> oam_entries;
+
+        /// @brief The number of sprites found on the current line.
+        unsigned int oam_entry_count;
+
         /// @brief Scanline state machine modes.
         enum Mode
         {
@@ -246,6 +369,21 @@ namespace GameBoy
             Drawing
         };
 
+        /// @brief The number of T-cycles spent in each mode per scanline.
+        static constexpr std::array<unsigned int, 4> mode_cycles =
+        {
+            204, // HBlank
+            456, // VBlankOrDisabled
+            80,  // OAMSearch
+            172  // Drawing
+        };
+
+        /// @brief Enters a mode and schedules its end.
+        /// @param mode The mode to enter.
+        /// @param timestamp The timestamp the mode begins at.
+        auto enter_mode(const Mode mode, const uint64_t timestamp) noexcept
+        -> void;
+
         /// @brief Render state set up by the call to `set_LCDC()`.
         struct
         {
@@ -270,6 +408,16 @@ namespace GameBoy
             bool signed_tile_id;
         } render_state;
 
+        /// @brief The number of tiles in VRAM, at $8000 - $97FF.
+        static constexpr auto TILES{ 384 };
+
+        /// @brief The tile data decoded to color numbers, one row of 8 pixels
+        /// per entry. It's decoded lazily, when a changed tile is drawn.
+        std::array<std::array<uint8_t, 8>, TILES * 8> tile_rows;
+
+        /// @brief Tiles changed since they were last decoded.
+        std::bitset<TILES> dirty_tiles;
+
         /// @brief System bus instance
         SystemBus& m_bus;
     };
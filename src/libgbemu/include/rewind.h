@@ -0,0 +1,127 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace GameBoy
+{
+    class System;
+
+    /// @brief Defines a history of save states of a system, taken once per
+    /// frame, which the system can be rewound through.
+    ///
+    /// Only the most recent state is kept as is. Every state before it is
+    /// stored as the XOR of it and the state after it, with the runs of
+    /// unchanged 16-byte blocks squeezed out, in a ring buffer of a fixed
+    /// size. Once the ring buffer is full, the oldest states are discarded to
+    /// make room for new ones.
+    class RewindBuffer final
+    {
+    public:
+        /// @brief Initializes a rewind buffer.
+        ///
+        /// The size of the states is taken from the system as it is now, so a
+        /// new buffer must be created whenever a different cartridge is
+        /// loaded.
+        /// @param system The system to take states of.
+        /// @param budget The number of bytes to store the states before the
+        /// most recent one in.
+        RewindBuffer(System& system, const std::size_t budget);
+
+        /// @brief Takes a state of the system, and adds it to the history.
+        auto push() noexcept -> void;
+
+        /// @brief Loads the most recent state of the history into the
+        /// system, and removes it from the history.
+        /// @return `true` if a state was loaded, or `false` if the history is
+        /// empty.
+        auto rewind() noexcept -> bool;
+
+        /// @brief Removes every state from the history.
+        auto clear() noexcept -> void;
+
+        /// @brief Returns the number of states in the history.
+        /// @return The number of states.
+        auto size() const noexcept -> std::size_t;
+
+        /// @brief Returns the number of bytes of the ring buffer in use.
+        /// @return The number of bytes.
+        auto used() const noexcept -> std::size_t;
+
+    private:
+        /// @brief Stores an encoded delta as the most recent one, discarding
+        /// the oldest ones until it fits.
+        /// @param size The size of the delta in `m_scratch`.
+        /// @return `true` if the delta was stored, or `false` if it doesn't
+        /// fit in the ring buffer at all.
+        auto store(const std::size_t size) noexcept -> bool;
+
+        /// @brief Copies bytes into the ring buffer, wrapping around its end.
+        /// @param position The position to copy to, before wrapping.
+        /// @param data The bytes to copy.
+        /// @param size The number of bytes.
+        auto ring_write(const uint64_t position,
+                        const uint8_t* data,
+                        const std::size_t size) noexcept -> void;
+
+        /// @brief Copies bytes out of the ring buffer, wrapping around its
+        /// end.
+        /// @param position The position to copy from, before wrapping.
+        /// @param data Receives the bytes.
+        /// @param size The number of bytes.
+        auto ring_read(const uint64_t position,
+                       uint8_t* data,
+                       const std::size_t size) const noexcept -> void;
+
+        /// @brief The system to take states of.
+        System& m_system;
+
+        /// @brief The size of a state.
+        std::size_t m_state_size;
+
+        /// @brief The most recent state, padded with zeroes to a whole number
+        /// of blocks.
+        std::vector<uint8_t> m_current;
+
+        /// @brief The state being taken.
+        std::vector<uint8_t> m_next;
+
+        /// @brief A delta being encoded or decoded, large enough for the
+        /// worst case.
+        std::vector<uint8_t> m_scratch;
+
+        /// @brief The deltas, each stored as its size, the encoded delta and
+        /// its size again, so that the ring buffer can be walked from either
+        /// end.
+        std::vector<uint8_t> m_ring;
+
+        /// @brief The position one past the most recent delta. Positions only
+        /// ever grow, and are wrapped to the size of `m_ring` on access.
+        uint64_t m_head;
+
+        /// @brief The position of the oldest delta.
+        uint64_t m_tail;
+
+        /// @brief The number of deltas stored.
+        std::size_t m_deltas;
+
+        /// @brief Is `m_current` a state of the history?
+        bool m_has_current;
+    };
+}
@@ -0,0 +1,95 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace GameBoy
+{
+    /// @brief Defines a read-only cartridge ROM image.
+    ///
+    /// Images opened from a file are memory mapped rather than read into
+    /// memory, and opening a file that an image is still alive for returns
+    /// that image. Any number of systems running the same game therefore
+    /// share a single copy of its ROM.
+    class RomImage final
+    {
+    public:
+        /// @brief Opens a ROM image from a file, or returns the image of the
+        /// file if it is already open.
+        ///
+        /// This function will throw an `std::runtime_error` if the file could
+        /// not be opened or mapped.
+        /// @param path The path of the file.
+        /// @return The image.
+        static auto open(const std::string& path)
+        -> std::shared_ptr<const RomImage>;
+
+        /// @brief Creates a ROM image from data already in memory.
+        /// @param data The data, which is moved into the image.
+        /// @return The image.
+        static auto from_data(std::vector<uint8_t> data)
+        -> std::shared_ptr<const RomImage>;
+
+        /// @brief Unmaps the file, if any.
+        ~RomImage() noexcept;
+
+        RomImage(const RomImage&) = delete;
+        auto operator=(const RomImage&) -> RomImage& = delete;
+
+        /// @brief Returns the ROM data.
+        /// @return The ROM data.
+        auto data() const noexcept -> const uint8_t*
+        {
+            return m_data;
+        }
+
+        /// @brief Returns the size of the ROM data.
+        /// @return The size in bytes.
+        auto size() const noexcept -> std::size_t
+        {
+            return m_size;
+        }
+
+        /// @brief Returns a byte of the ROM data.
+        /// @param index The offset of the byte, which must be less than
+        /// `size()`.
+        /// @return The byte.
+        auto operator[](const std::size_t index) const noexcept -> uint8_t
+        {
+            return m_data[index];
+        }
+
+    private:
+        RomImage() noexcept;
+
+        /// @brief The ROM data, either `m_mapping` or `m_owned`.
+        const uint8_t* m_data;
+
+        /// @brief The size of the ROM data in bytes.
+        std::size_t m_size;
+
+        /// @brief The file mapping, or `nullptr` if the image isn't backed by
+        /// a file.
+        void* m_mapping;
+
+        /// @brief The ROM data, if the image isn't backed by a file.
+        std::vector<uint8_t> m_owned;
+    };
+}
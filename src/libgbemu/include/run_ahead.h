@@ -0,0 +1,73 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "ppu.h"
+
+namespace GameBoy
+{
+    class System;
+
+    /// @brief Defines a frame runner which presents frames from ahead of the
+    /// system, hiding the input lag built into most games.
+    ///
+    /// Games usually read the joypad during one frame and show the result
+    /// during the next, or later. Each frame, the system is advanced by a
+    /// frame as usual, then its state is saved, a few more frames are run
+    /// speculatively with the same input, and the last of them is presented
+    /// before the state is restored. Input thus shows up on screen as many
+    /// frames earlier, at the cost of emulating as many frames more.
+    class RunAhead final
+    {
+    public:
+        /// @brief Initializes a run-ahead frame runner.
+        /// @param system The system to run.
+        explicit RunAhead(System& system) noexcept;
+
+        /// @brief Executes a frame through `System::run_frame()`, then runs
+        /// ahead of it to render the frame to present.
+        ///
+        /// The speculative frames are rendered into a frame of their own, and
+        /// the audio samples generated during them are discarded, as is their
+        /// progress through the render policy, so the system ends up exactly
+        /// as `System::run_frame()` alone would have left it.
+        /// @param frames The number of frames to run ahead by, 0 to present
+        /// the frame the system rendered.
+        /// @return The number of T-cycles taken by the frame executed, not
+        /// counting the speculative frames.
+        auto run_frame(const unsigned int frames) noexcept -> unsigned int;
+
+        /// @brief Returns the frame to present after `run_frame()`.
+        /// @return The last speculative frame, or the frame the system
+        /// rendered if it didn't run ahead.
+        auto frame() const noexcept -> const ScreenData&;
+
+    private:
+        /// @brief The system to run.
+        System& m_system;
+
+        /// @brief The state of the system before the speculative frames.
+        std::vector<uint8_t> m_state;
+
+        /// @brief The last speculative frame.
+        ScreenData m_frame;
+
+        /// @brief Did the last frame run ahead?
+        bool m_ahead;
+    };
+}
@@ -14,16 +14,101 @@
 
 #pragma once
 
+#include <array>
+#include <cstdint>
+
 namespace GameBoy
 {
-    class Scheduler
+    class StateSerializer;
+
+    /// @brief Types of events that can be scheduled.
+    ///
+    /// If more than one event is due at the same timestamp, they will be
+    /// dispatched in the order listed here.
+    enum class Event : unsigned int
+    {
+        /// @brief The APU frame sequencer is to be clocked.
+        APUFrameSequencer,
+
+        /// @brief The PPU has reached the end of the current mode.
+        PPUModeChange,
+
+        /// @brief TIMA is to overflow.
+        TimerOverflow,
+
+        /// @brief An OAM DMA transfer has completed.
+        DMACompletion,
+
+        /// @brief No event. This must always be the last entry.
+        None
+    };
+
+    /// @brief Defines a timestamped event queue keyed on the master cycle
+    /// counter.
+    ///
+    /// Every event type has its own fixed slot, so at most one instance of
+    /// each type can be pending at a time. Scheduling an event that is
+    /// already pending moves it to the new timestamp.
+    class Scheduler final
     {
     public:
+        /// @brief Initializes the scheduler.
+        Scheduler() noexcept;
+
         /// @brief Resets the scheduler to the startup state.
         auto reset() noexcept -> void;
 
-        auto until_next_event() noexcept -> void;
+        /// @brief Saves or loads the state of the scheduler.
+        ///
+        /// Every pending event is part of the state, along with the timestamp
+        /// it is due at.
+        /// @param state The save state serializer.
+        auto serialize(StateSerializer& state) noexcept -> void;
+
+        /// @brief Schedules an event relative to the current timestamp.
+        /// @param event The event to schedule.
+        /// @param delay The number of T-cycles from now the event is due.
+        auto schedule(const Event event, const uint64_t delay) noexcept -> void;
+
+        /// @brief Schedules an event at an absolute timestamp.
+        /// @param event The event to schedule.
+        /// @param timestamp The timestamp the event is due at.
+        auto schedule_at(const Event event,
+                         const uint64_t timestamp) noexcept -> void;
+
+        /// @brief Removes an event from the queue, if it is pending.
+        /// @param event The event to remove.
+        auto cancel(const Event event) noexcept -> void;
+
+        /// @brief Returns the number of T-cycles until the next event is due.
+        /// @return 0 if an event is already due, or the number of T-cycles.
+        auto until_next_event() const noexcept -> uint64_t;
+
+        /// @brief Removes the earliest event that is due from the queue.
+        /// @param timestamp Receives the timestamp the event was due at.
+        /// @return The event, or `Event::None` if no event is due.
+        auto pop_due(uint64_t& timestamp) noexcept -> Event;
+
+        /// @brief Determines if any event is due.
+        /// @return `true` if an event is due, or `false` otherwise.
+        auto due() const noexcept -> bool
+        {
+            return timestamp >= next_deadline;
+        }
+
+        /// @brief The master cycle counter, in T-cycles.
+        uint64_t timestamp;
 
         unsigned int cpu_clock;
+
+    private:
+        /// @brief Recalculates the earliest deadline of all pending events.
+        auto update_next_deadline() noexcept -> void;
+
+        /// @brief The timestamp each event is due at, or `NOT_PENDING`.
+        std::array<uint64_t, static_cast<unsigned int>(Event::None)> deadlines;
+
+        /// @brief The earliest deadline of all pending events.
+        uint64_t next_deadline;
     };
 }
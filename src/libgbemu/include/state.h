@@ -0,0 +1,142 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace GameBoy
+{
+    /// @brief Defines a cursor over a save state buffer, which devices pass
+    /// their state through to save or load it.
+    ///
+    /// The same `serialize()` function of a device both saves and loads its
+    /// state, depending on the mode of the serializer, so that the two can't
+    /// get out of step with each other. Fields are stored back to back in the
+    /// order they are passed, in host byte order, without any allocations.
+    class StateSerializer final
+    {
+    public:
+        /// @brief What the serializer does with the fields passed to it.
+        enum class Mode
+        {
+            /// @brief The fields are only counted, to determine the size of a
+            /// state.
+            Measure,
+
+            /// @brief The fields are copied into the buffer.
+            Save,
+
+            /// @brief The fields are copied out of the buffer.
+            Load
+        };
+
+        /// @brief Initializes a serializer measuring the size of a state.
+        /// @param memory Include the memory shared between forked systems?
+        explicit StateSerializer(const bool memory = true) noexcept;
+
+        /// @brief Initializes a serializer saving a state.
+        /// @param data The buffer to save the state to.
+        /// @param size The size of the buffer.
+        /// @param memory Include the memory shared between forked systems?
+        StateSerializer(uint8_t* data,
+                        const std::size_t size,
+                        const bool memory = true) noexcept;
+
+        /// @brief Initializes a serializer loading a state.
+        /// @param data The buffer to load the state from. It is never written
+        /// to.
+        /// @param size The size of the buffer.
+        /// @param memory Include the memory shared between forked systems?
+        StateSerializer(const uint8_t* data,
+                        const std::size_t size,
+                        const bool memory = true) noexcept;
+
+        /// @brief Determines if a state is being loaded.
+        /// @return `true` if a state is being loaded, or `false` otherwise.
+        auto loading() const noexcept -> bool;
+
+        /// @brief Determines if a state is being saved.
+        /// @return `true` if a state is being saved, or `false` otherwise.
+        auto saving() const noexcept -> bool;
+
+        /// @brief Returns the number of bytes passed through so far.
+        /// @return The number of bytes.
+        auto offset() const noexcept -> std::size_t;
+
+        /// @brief Determines if the buffer was too small for the fields passed
+        /// through. Fields past the end are left untouched.
+        /// @return `true` if the buffer was too small, or `false` otherwise.
+        auto overflowed() const noexcept -> bool;
+
+        /// @brief Determines if the memory shared between forked systems, i.e.
+        /// `CowMemory`, is part of the state.
+        /// @return `true` if the memory is included, or `false` if it is left
+        /// out.
+        auto memory() const noexcept -> bool;
+
+        /// @brief Saves or loads a field.
+        /// @param value The field.
+        template<class T>
+        auto field(T& value) noexcept -> void
+        {
+            static_assert(std::is_trivially_copyable_v<T>,
+                          "fields must be copyable as raw bytes");
+            bytes(&value, sizeof(T));
+        }
+
+        /// @brief Saves or loads raw bytes.
+        ///
+        /// This is called for every field, so it's kept here for it to be
+        /// inlined with the size known at compile time.
+        /// @param data The bytes.
+        /// @param size The number of bytes.
+        auto bytes(void* data, const std::size_t size) noexcept -> void
+        {
+            if ((m_mode != Mode::Measure) && ((m_offset + size) <= m_size))
+            {
+                if (m_mode == Mode::Save)
+                {
+                    std::memcpy(m_data + m_offset, data, size);
+                }
+                else
+                {
+                    std::memcpy(data, m_data + m_offset, size);
+                }
+            }
+            m_offset += size;
+        }
+
+    private:
+        /// @brief What the serializer does with the fields passed to it.
+        Mode m_mode;
+
+        /// @brief The buffer, or `nullptr` if measuring. It is only written to
+        /// when saving.
+        uint8_t* m_data;
+
+        /// @brief The size of the buffer.
+        std::size_t m_size;
+
+        /// @brief The number of bytes passed through so far.
+        std::size_t m_offset;
+
+        /// @brief Is the memory shared between forked systems included?
+        bool m_memory;
+    };
+}
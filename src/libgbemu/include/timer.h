@@ -18,6 +18,7 @@
 
 namespace GameBoy
 {
+    class StateSerializer;
     class SystemBus;
 
     /// @brief Defines the timer device.
@@ -29,9 +30,39 @@ namespace GameBoy
         /// @brief Resets the timer to the startup state.
         auto reset() noexcept -> void;
 
-        /// @brief Advances the timer by 1 m-cycle.
+        /// @brief Saves or loads the state of the timer.
+        /// @param state The save state serializer.
+        auto serialize(StateSerializer& state) noexcept -> void;
+
+        /// @brief Brings the timer up to date with the current timestamp.
+        auto sync() noexcept -> void;
+
+        /// @brief Handles a TIMA overflow event.
         auto step() noexcept -> void;
 
+        /// @brief Returns the value of the DIV register.
+        /// @return The DIV register.
+        auto get_DIV() noexcept -> uint8_t;
+
+        /// @brief Returns the value of the TIMA register.
+        /// @return The TIMA register.
+        auto get_TIMA() noexcept -> uint8_t;
+
+        /// @brief Resets the DIV register to $00.
+        auto set_DIV() noexcept -> void;
+
+        /// @brief Updates TIMA and reschedules the next overflow.
+        /// @param data The new TIMA value.
+        auto set_TIMA(const uint8_t data) noexcept -> void;
+
+        /// @brief Updates TMA.
+        /// @param data The new TMA value.
+        auto set_TMA(const uint8_t data) noexcept -> void;
+
+        /// @brief Updates TAC and reschedules the next overflow.
+        /// @param data The new TAC value.
+        auto set_TAC(const uint8_t data) noexcept -> void;
+
         /// @brief Divider
         ///
         /// This register is incremented at rate of 16384Hz. Writing any value
@@ -80,7 +111,17 @@ namespace GameBoy
         uint16_t tima_counter;
 
     private:
+        /// @brief Schedules the next TIMA overflow, if the timer is active.
+        auto schedule_overflow() noexcept -> void;
+
+        /// @brief Returns the number of T-cycles between TIMA increments.
+        /// @return The number of T-cycles.
+        auto threshold() const noexcept -> unsigned int;
+
+        /// @brief The timestamp the timer was last brought up to date at.
+        uint64_t last_sync;
+
         /// @brief System bus instance
         SystemBus& bus;
     };
-}
\ No newline at end of file
+}
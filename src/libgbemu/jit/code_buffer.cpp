@@ -0,0 +1,106 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <cstring>
+#include "code_buffer.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+using namespace GameBoy;
+
+/// @brief Allocates the region.
+/// @param size The size of the region in bytes.
+CodeBuffer::CodeBuffer(const std::size_t size) noexcept : size(size), used(0)
+{
+#ifdef _WIN32
+    memory = static_cast<uint8_t*>(VirtualAlloc(nullptr,
+                                                size,
+                                                MEM_COMMIT | MEM_RESERVE,
+                                                PAGE_EXECUTE_READ));
+#else
+    void* const region{ mmap(nullptr,
+                             size,
+                             PROT_READ | PROT_EXEC,
+                             MAP_PRIVATE | MAP_ANONYMOUS,
+                             -1,
+                             0) };
+
+    memory = (region == MAP_FAILED) ? nullptr : static_cast<uint8_t*>(region);
+#endif
+}
+
+/// @brief Frees the region.
+CodeBuffer::~CodeBuffer() noexcept
+{
+    if (!memory)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    VirtualFree(memory, 0, MEM_RELEASE);
+#else
+    munmap(memory, size);
+#endif
+}
+
+/// @brief Copies code into the region.
+/// @param code The code to copy.
+/// @return The address of the code, or `nullptr` if the region is full or
+/// could not be allocated.
+auto CodeBuffer::write(const std::vector<uint8_t>& code) noexcept -> uint8_t*
+{
+    if (!memory || (code.size() > (size - used)) || !protect(true))
+    {
+        return nullptr;
+    }
+
+    uint8_t* const address{ memory + used };
+
+    std::memcpy(address, code.data(), code.size());
+    used += code.size();
+
+    return protect(false) ? address : nullptr;
+}
+
+/// @brief Discards all code in the region.
+auto CodeBuffer::clear() noexcept -> void
+{
+    used = 0;
+}
+
+/// @brief Changes the protection of the region.
+/// @param writable `true` to make the region writable, or `false` to make it
+/// executable.
+/// @return `true` if the protection was changed, or `false` otherwise.
+auto CodeBuffer::protect(const bool writable) noexcept -> bool
+{
+#ifdef _WIN32
+    DWORD old_protection;
+
+    return VirtualProtect(memory,
+                          size,
+                          writable ? PAGE_READWRITE : PAGE_EXECUTE_READ,
+                          &old_protection);
+#else
+    return mprotect(memory,
+                    size,
+                    writable ? (PROT_READ | PROT_WRITE)
+                             : (PROT_READ | PROT_EXEC)) == 0;
+#endif
+}
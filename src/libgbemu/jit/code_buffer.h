@@ -0,0 +1,67 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace GameBoy
+{
+    /// @brief Defines a region of executable memory native code is placed
+    /// in.
+    ///
+    /// The region is never writable and executable at the same time: it is
+    /// made writable only for as long as it takes to copy code into it.
+    class CodeBuffer final
+    {
+    public:
+        /// @brief Allocates the region.
+        /// @param size The size of the region in bytes.
+        explicit CodeBuffer(const std::size_t size) noexcept;
+
+        /// @brief Frees the region.
+        ~CodeBuffer() noexcept;
+
+        CodeBuffer(const CodeBuffer&) = delete;
+        auto operator=(const CodeBuffer&) -> CodeBuffer& = delete;
+
+        /// @brief Copies code into the region.
+        /// @param code The code to copy.
+        /// @return The address of the code, or `nullptr` if the region is
+        /// full or could not be allocated.
+        auto write(const std::vector<uint8_t>& code) noexcept -> uint8_t*;
+
+        /// @brief Discards all code in the region.
+        auto clear() noexcept -> void;
+
+    private:
+        /// @brief Changes the protection of the region.
+        /// @param writable `true` to make the region writable, or `false` to
+        /// make it executable.
+        /// @return `true` if the protection was changed, or `false`
+        /// otherwise.
+        auto protect(const bool writable) noexcept -> bool;
+
+        /// @brief The region, or `nullptr` if it could not be allocated.
+        uint8_t* memory;
+
+        /// @brief The size of the region in bytes.
+        std::size_t size;
+
+        /// @brief The number of bytes in use.
+        std::size_t used;
+    };
+}
@@ -0,0 +1,564 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+#include "../include/block_cache.h"
+#include "../include/bus.h"
+#include "../include/cpu.h"
+#include "recompiler.h"
+
+using namespace GameBoy;
+
+/// @brief The size of the code buffer in bytes.
+constexpr std::size_t CODE_BUFFER_SIZE{ 4 * 1024 * 1024 };
+
+/// @brief The minimum number of instructions worth recompiling.
+constexpr std::size_t MIN_RUN_LENGTH{ 2 };
+
+using Registers = decltype(CPU::reg);
+
+/// @brief Offsets of the 8-bit registers in the order they are encoded in an
+/// opcode: B, C, D, E, H, L, (HL), A. (HL) is never used.
+static constexpr std::array<uint8_t, 8> r8_offsets
+{
+    offsetof(Registers, b),
+    offsetof(Registers, c),
+    offsetof(Registers, d),
+    offsetof(Registers, e),
+    offsetof(Registers, h),
+    offsetof(Registers, l),
+    0,
+    offsetof(Registers, a)
+};
+
+/// @brief Offsets of the register pairs in the order they are encoded in an
+/// opcode: BC, DE, HL, SP.
+static constexpr std::array<uint8_t, 4> r16_offsets
+{
+    offsetof(Registers, bc),
+    offsetof(Registers, de),
+    offsetof(Registers, hl),
+    offsetof(Registers, sp)
+};
+
+constexpr uint8_t A_OFFSET{ offsetof(Registers, a) };
+constexpr uint8_t F_OFFSET{ offsetof(Registers, f) };
+
+/// @brief Generates the table converting the x86 flags stored by LAHF to the
+/// Zero, Half Carry and Carry bits of the Flag (F) register.
+/// @return The table.
+static constexpr auto make_flag_table() noexcept -> std::array<uint8_t, 256>
+{
+    std::array<uint8_t, 256> table{ };
+
+    for (unsigned int ah{ 0 }; ah < table.size(); ++ah)
+    {
+        unsigned int f{ 0 };
+
+        if (ah & 0x40) f |= CPU::FlagBit::Zero;      // ZF
+        if (ah & 0x10) f |= CPU::FlagBit::HalfCarry; // AF
+        if (ah & 0x01) f |= CPU::FlagBit::Carry;     // CF
+
+        table[ah] = static_cast<uint8_t>(f);
+    }
+    return table;
+}
+
+static constexpr std::array<uint8_t, 256> flag_table{ make_flag_table() };
+
+/// @brief Determines if an instruction can be recompiled.
+/// @param handler The handler index of the instruction.
+/// @return `true` if the instruction neither accesses memory nor transfers
+/// control, or `false` otherwise.
+static auto recompilable(const uint16_t handler) noexcept -> bool
+{
+    // CB-prefixed instructions, except those operating on (HL).
+    if (handler >= 0x100)
+    {
+        return (handler & 7) != 6;
+    }
+
+    const unsigned int x{ (handler >> 6) & 3u };
+    const unsigned int y{ (handler >> 3) & 7u };
+    const unsigned int z{ handler & 7u };
+
+    switch (x)
+    {
+        case 0:
+            switch (z)
+            {
+                case 0:  return y == 0;                   // NOP
+                case 1:  return (y & 1) == 0;             // LD rr, $imm16
+                case 3:  return true;                     // INC rr, DEC rr
+                case 4:
+                case 5:
+                case 6:  return y != 6;                   // INC r, DEC r, LD r, $imm8
+                case 7:  return true;                     // RLCA ... CCF
+                default: return false;
+            }
+
+        case 1:  return (y != 6) && (z != 6);             // LD r, r
+        case 2:  return z != 6;                           // ALU A, r
+        default: return (z == 6) || (handler == 0xF9);    // ALU A, $imm8, LD SP, HL
+    }
+}
+
+/// @brief Returns the number of T-cycles taken by an instruction in addition
+/// to fetching it.
+/// @param handler The handler index of the instruction.
+/// @return The number of T-cycles.
+static auto internal_cycles(const uint16_t handler) noexcept -> unsigned int
+{
+    // INC rr, DEC rr and LD SP, HL take an extra m-cycle.
+    if ((handler < 0x40 && (handler & 7) == 3) || handler == 0xF9)
+    {
+        return 4;
+    }
+    return 0;
+}
+
+/// @brief Defines an assembler for the handful of x86-64 instructions the
+/// recompiler uses.
+///
+/// RBX holds the CPU instance and R12 holds its registers for the entire
+/// lifetime of the native code, as both are callee-saved in every calling
+/// convention we support. RAX, RCX and RDX are scratch registers.
+class Emitter final
+{
+public:
+    /// @brief Emits an 8-bit value.
+    auto byte(const uint8_t data) -> void
+    {
+        code.push_back(data);
+    }
+
+    /// @brief Emits several 8-bit values.
+    auto bytes(std::initializer_list<uint8_t> data) -> void
+    {
+        code.insert(code.end(), data);
+    }
+
+    /// @brief Emits a 16-bit value.
+    auto word(const uint16_t data) -> void
+    {
+        byte(data & 0xFF);
+        byte(data >> 8);
+    }
+
+    /// @brief Emits a 64-bit value.
+    auto qword(const uint64_t data) -> void
+    {
+        for (unsigned int shift{ 0 }; shift < 64; shift += 8)
+        {
+            byte((data >> shift) & 0xFF);
+        }
+    }
+
+    /// @brief Emits the function prologue.
+    auto prologue() -> void
+    {
+        bytes({ 0x53 });                   // push rbx
+        bytes({ 0x41, 0x54 });             // push r12
+
+        // Keeps the stack 16-byte aligned for calls, and reserves the 32
+        // bytes of shadow space the Windows x64 calling convention requires.
+        bytes({ 0x48, 0x83, 0xEC, 0x28 }); // sub rsp, 40
+
+#ifdef _WIN32
+        bytes({ 0x48, 0x89, 0xCB });       // mov rbx, rcx
+        bytes({ 0x49, 0x89, 0xD4 });       // mov r12, rdx
+#else
+        bytes({ 0x48, 0x89, 0xFB });       // mov rbx, rdi
+        bytes({ 0x49, 0x89, 0xF4 });       // mov r12, rsi
+#endif
+    }
+
+    /// @brief Emits the function epilogue.
+    auto epilogue() -> void
+    {
+        bytes({ 0x48, 0x83, 0xC4, 0x28 }); // add rsp, 40
+        bytes({ 0x41, 0x5C });             // pop r12
+        bytes({ 0x5B });                   // pop rbx
+        bytes({ 0xC3 });                   // ret
+    }
+
+    /// @brief movzx eax, byte [r12 + offset]
+    auto load_eax(const uint8_t offset) -> void
+    {
+        bytes({ 0x41, 0x0F, 0xB6, 0x44, 0x24, offset });
+    }
+
+    /// @brief movzx ecx, byte [r12 + offset]
+    auto load_ecx(const uint8_t offset) -> void
+    {
+        bytes({ 0x41, 0x0F, 0xB6, 0x4C, 0x24, offset });
+    }
+
+    /// @brief movzx edx, byte [r12 + offset]
+    auto load_edx(const uint8_t offset) -> void
+    {
+        bytes({ 0x41, 0x0F, 0xB6, 0x54, 0x24, offset });
+    }
+
+    /// @brief mov byte [r12 + offset], al
+    auto store_al(const uint8_t offset) -> void
+    {
+        bytes({ 0x41, 0x88, 0x44, 0x24, offset });
+    }
+
+    /// @brief mov byte [r12 + offset], imm8
+    auto store_imm8(const uint8_t offset, const uint8_t data) -> void
+    {
+        bytes({ 0x41, 0xC6, 0x44, 0x24, offset, data });
+    }
+
+    /// @brief mov word [r12 + offset], imm16
+    auto store_imm16(const uint8_t offset, const uint16_t data) -> void
+    {
+        bytes({ 0x66, 0x41, 0xC7, 0x44, 0x24, offset });
+        word(data);
+    }
+
+    /// @brief inc word [r12 + offset] or dec word [r12 + offset]
+    auto step_word(const uint8_t offset, const bool increment) -> void
+    {
+        bytes({ 0x66, 0x41, 0xFF, increment ? uint8_t{ 0x44 }
+                                            : uint8_t{ 0x4C }, 0x24, offset });
+    }
+
+    /// @brief Copies a 16-bit register.
+    auto copy_word(const uint8_t destination, const uint8_t source) -> void
+    {
+        bytes({ 0x41, 0x0F, 0xB7, 0x44, 0x24, source });            // movzx eax, word [r12 + source]
+        bytes({ 0x66, 0x41, 0x89, 0x44, 0x24, destination });       // mov word [r12 + destination], ax
+    }
+
+    /// @brief Loads the Carry flag bit of the Flag (F) register into the
+    /// x86 carry flag.
+    auto load_carry() -> void
+    {
+        load_edx(F_OFFSET);
+        bytes({ 0x0F, 0xBA, 0xE2, 0x04 }); // bt edx, 4
+    }
+
+    /// @brief Stores the x86 flags in AH.
+    ///
+    /// This must be emitted directly after the instruction setting them.
+    auto lahf() -> void
+    {
+        bytes({ 0x9F });                   // lahf
+    }
+
+    /// @brief Converts the x86 flags stored in AH by `lahf()` to the Zero,
+    /// Half Carry and Carry bits of the Flag (F) register, and places them
+    /// in AL. Clobbers EAX and ECX.
+    auto convert_flags() -> void
+    {
+        bytes({ 0x0F, 0xB6, 0xC4 });       // movzx eax, ah
+        bytes({ 0x48, 0xB9 });             // mov rcx, flag_table
+        qword(reinterpret_cast<uint64_t>(flag_table.data()));
+        bytes({ 0x0F, 0xB6, 0x04, 0x01 }); // movzx eax, byte [rcx + rax]
+    }
+
+    /// @brief Calls an interpreter handler.
+    auto call(const uint64_t function) -> void
+    {
+#ifdef _WIN32
+        bytes({ 0x48, 0x89, 0xD9 });       // mov rcx, rbx
+#else
+        bytes({ 0x48, 0x89, 0xDF });       // mov rdi, rbx
+#endif
+        bytes({ 0x48, 0xB8 });             // mov rax, function
+        qword(function);
+        bytes({ 0xFF, 0xD0 });             // call rax
+    }
+
+    /// @brief The code emitted so far.
+    std::vector<uint8_t> code;
+};
+
+/// @brief Emits an ALU operation on the Accumulator (register A).
+/// @param e The emitter to use.
+/// @param operation ADD, ADC, SUB, SBC, AND, XOR, OR, CP.
+/// @param source The offset of the operand register, if `immediate` is
+/// `false`.
+/// @param immediate Is the operand an immediate value?
+/// @param data The immediate value, if `immediate` is `true`.
+static auto emit_alu(Emitter& e,
+                     const unsigned int operation,
+                     const uint8_t source,
+                     const bool immediate,
+                     const uint8_t data) -> void
+{
+    // The x86 opcodes for `op r/m8, r8` and `op al, imm8`, in SM83 order.
+    static constexpr std::array<uint8_t, 8> reg_opcodes
+    {
+        0x00, 0x10, 0x28, 0x18, 0x20, 0x30, 0x08, 0x38
+    };
+
+    static constexpr std::array<uint8_t, 8> imm_opcodes
+    {
+        0x04, 0x14, 0x2C, 0x1C, 0x24, 0x34, 0x0C, 0x3C
+    };
+
+    e.load_eax(A_OFFSET);
+
+    if (!immediate)
+    {
+        e.load_ecx(source);
+    }
+
+    // ADC and SBC
+    if (operation == 1 || operation == 3)
+    {
+        e.load_carry();
+    }
+
+    if (immediate)
+    {
+        e.bytes({ imm_opcodes[operation], data });        // op al, imm8
+    }
+    else
+    {
+        e.bytes({ reg_opcodes[operation], 0xC8 });        // op al, cl
+    }
+
+    e.lahf();
+
+    // CP discards the result.
+    if (operation != 7)
+    {
+        e.store_al(A_OFFSET);
+    }
+    e.convert_flags();
+
+    switch (operation)
+    {
+        // SUB, SBC, CP
+        case 2:
+        case 3:
+        case 7:
+            e.bytes({ 0x0C, CPU::FlagBit::Subtract });    // or al, N
+            break;
+
+        // AND: the x86 half carry flag is undefined, SM83 sets it.
+        case 4:
+            e.bytes({ 0x24, CPU::FlagBit::Zero });        // and al, Z
+            e.bytes({ 0x0C, CPU::FlagBit::HalfCarry });   // or al, H
+            break;
+
+        // XOR, OR
+        case 5:
+        case 6:
+            e.bytes({ 0x24, CPU::FlagBit::Zero });        // and al, Z
+            break;
+    }
+    e.store_al(F_OFFSET);
+}
+
+/// @brief Emits an 8-bit increment or decrement.
+/// @param e The emitter to use.
+/// @param offset The offset of the register.
+/// @param increment `true` for INC, `false` for DEC.
+static auto emit_inc_dec(Emitter& e,
+                         const uint8_t offset,
+                         const bool increment) -> void
+{
+    e.load_eax(offset);
+    e.bytes({ 0xFE, increment ? uint8_t{ 0xC0 } : uint8_t{ 0xC8 } }); // inc al / dec al
+    e.lahf();
+    e.store_al(offset);
+    e.convert_flags();
+
+    // The Carry flag is left untouched.
+    e.bytes({ 0x24, CPU::FlagBit::Zero | CPU::FlagBit::HalfCarry });    // and al, Z | H
+    e.load_ecx(F_OFFSET);
+    e.bytes({ 0x80, 0xE1, CPU::FlagBit::Carry });                   // and cl, C
+    e.bytes({ 0x08, 0xC8 });                                        // or al, cl
+
+    if (!increment)
+    {
+        e.bytes({ 0x0C, CPU::FlagBit::Subtract });                  // or al, N
+    }
+    e.store_al(F_OFFSET);
+}
+
+/// @brief Emits a recompilable instruction.
+/// @param e The emitter to use.
+/// @param instruction The instruction.
+/// @param handlers The interpreter's dispatch table.
+template<class Handlers>
+static auto emit_instruction(Emitter& e,
+                             const DecodedInstruction& instruction,
+                             const Handlers& handlers) -> void
+{
+    const unsigned int handler{ instruction.handler };
+
+    const unsigned int x{ (handler >> 6) & 3u };
+    const unsigned int y{ (handler >> 3) & 7u };
+    const unsigned int z{ handler & 7u };
+    const unsigned int p{ y >> 1 };
+
+    const auto call_handler = [&]()
+    {
+        e.call(reinterpret_cast<uint64_t>(handlers[handler]));
+    };
+
+    // Rotates, shifts and bit operations are comparatively rare, so they're
+    // left to the interpreter's handlers.
+    if (handler >= 0x100)
+    {
+        call_handler();
+        return;
+    }
+
+    switch (x)
+    {
+        case 0:
+            switch (z)
+            {
+                case 0: // NOP
+                    return;
+
+                case 1: // LD rr, $imm16
+                    e.store_imm16(r16_offsets[p], instruction.operand);
+                    return;
+
+                case 3: // INC rr, DEC rr
+                    e.step_word(r16_offsets[p], (y & 1) == 0);
+                    return;
+
+                case 4: // INC r
+                    emit_inc_dec(e, r8_offsets[y], true);
+                    return;
+
+                case 5: // DEC r
+                    emit_inc_dec(e, r8_offsets[y], false);
+                    return;
+
+                case 6: // LD r, $imm8
+                    e.store_imm8(r8_offsets[y], instruction.operand);
+                    return;
+
+                default: // RLCA, RRCA, RLA, RRA, DAA, CPL, SCF, CCF
+                    call_handler();
+                    return;
+            }
+
+        case 1: // LD r, r
+            e.load_eax(r8_offsets[z]);
+            e.store_al(r8_offsets[y]);
+            return;
+
+        case 2: // ALU A, r
+            emit_alu(e, y, r8_offsets[z], false, 0);
+            return;
+
+        default:
+            if (handler == 0xF9) // LD SP, HL
+            {
+                e.copy_word(r16_offsets[3], r16_offsets[2]);
+                return;
+            }
+
+            // ALU A, $imm8
+            emit_alu(e, y, 0, true, instruction.operand);
+            return;
+    }
+}
+
+/// @brief Initializes the recompiler.
+Recompiler::Recompiler() noexcept : buffer(CODE_BUFFER_SIZE)
+{ }
+
+/// @brief Compiles every run of recompilable instructions in a block.
+/// @param block The block to compile.
+/// @return `true` if the block was compiled, or `false` if the code buffer is
+/// full.
+auto Recompiler::compile(BasicBlock& block) noexcept -> bool
+{
+    const auto& instructions{ block.instructions };
+
+    Emitter e;
+    std::vector<NativeRun> runs(instructions.size(), NativeRun{ });
+    std::vector<std::size_t> offsets(instructions.size(), 0);
+
+    for (std::size_t start{ 0 }; start < instructions.size();)
+    {
+        std::size_t end{ start };
+
+        while (end < instructions.size() &&
+               recompilable(instructions[end].handler))
+        {
+            ++end;
+        }
+
+        if ((end - start) >= MIN_RUN_LENGTH)
+        {
+            auto& run{ runs[start] };
+
+            run.count   = end - start;
+            run.cycles  = 0;
+            run.next_pc = instructions[end - 1].pc + instructions[end - 1].length;
+
+            offsets[start] = e.code.size();
+            e.prologue();
+
+            for (std::size_t index{ start }; index < end; ++index)
+            {
+                const auto& instruction{ instructions[index] };
+
+                emit_instruction(e, instruction, CPU::handlers);
+                run.cycles += instruction.cycles +
+                              internal_cycles(instruction.handler);
+            }
+            e.epilogue();
+        }
+        start = (end == start) ? end + 1 : end;
+    }
+
+    if (!e.code.empty())
+    {
+        uint8_t* const code{ buffer.write(e.code) };
+
+        if (!code)
+        {
+            return false;
+        }
+
+        for (std::size_t index{ 0 }; index < runs.size(); ++index)
+        {
+            if (runs[index].count != 0)
+            {
+                runs[index].code =
+                reinterpret_cast<NativeRun::Code>(code + offsets[index]);
+            }
+        }
+    }
+
+    block.runs = std::move(runs);
+    return true;
+}
+
+/// @brief Discards all native code.
+///
+/// Every block compiled previously must be discarded as well.
+auto Recompiler::clear() noexcept -> void
+{
+    buffer.clear();
+}
@@ -0,0 +1,52 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include "code_buffer.h"
+
+namespace GameBoy
+{
+    struct BasicBlock;
+
+    /// @brief Defines an x86-64 recompiler for basic blocks.
+    ///
+    /// Only instructions that neither access memory nor transfer control are
+    /// recompiled, as those are the only ones that can be executed
+    /// back-to-back without interleaving with the devices. Everything else is
+    /// left to the cached interpreter. The instructions are either translated
+    /// directly, or compiled to calls to the same handlers the interpreter
+    /// uses.
+    class Recompiler final
+    {
+    public:
+        /// @brief Initializes the recompiler.
+        Recompiler() noexcept;
+
+        /// @brief Compiles every run of recompilable instructions in a block.
+        /// @param block The block to compile.
+        /// @return `true` if the block was compiled, or `false` if the code
+        /// buffer is full.
+        auto compile(BasicBlock& block) noexcept -> bool;
+
+        /// @brief Discards all native code.
+        ///
+        /// Every block compiled previously must be discarded as well.
+        auto clear() noexcept -> void;
+
+    private:
+        /// @brief Native code instance
+        CodeBuffer buffer;
+    };
+}
@@ -12,15 +12,59 @@
 // OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
 // CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
+#include <algorithm>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 #include "bus.h"
 #include "ppu.h"
+#include "state.h"
 
 using namespace GameBoy;
 
+/// @brief Translates a decoded row of tile data to colors.
+/// @param out Receives the 8 pixels.
+/// @param pixels The color numbers of the pixels, from left to right.
+/// @param colors The colors of the color numbers.
+static inline auto expand_row(uint32_t* const out,
+                              const std::array<uint8_t, 8>& pixels,
+                              const std::array<uint32_t, 4>& colors) noexcept
+-> void
+{
+#ifdef __AVX2__
+    // The colors are looked up for all 8 pixels at once, with the color
+    // numbers as indexes into a register holding them.
+    const __m256i palette
+    {
+        _mm256_castsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(colors.data())))
+    };
+
+    const __m256i numbers
+    {
+        _mm256_cvtepu8_epi32(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pixels.data())))
+    };
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out),
+                        _mm256_permutevar8x32_epi32(palette, numbers));
+#else
+    for (unsigned int pixel{ 0 }; pixel < 8; ++pixel)
+    {
+        out[pixel] = colors[pixels[pixel]];
+    }
+#endif
+}
+
 /// @brief Initializes the picture processing unit (PPU).
 /// @param bus The system bus instance.
 PPU::PPU(SystemBus& bus) noexcept : m_bus(bus)
 {
+    framebuffer = &screen_data;
+
+    render_policy = RenderPolicy::All;
+    render_interval = 1;
+
     reset();
 }
 
@@ -35,8 +79,25 @@ auto PPU::get_LCDC() noexcept -> uint8_t
 /// @param data The new LCDC value.
 auto PPU::set_LCDC(const uint8_t data) noexcept -> void
 {
+    const auto was_enabled{ LCDC.enabled != 0 };
+
     LCDC.byte = data;
 
+    if (was_enabled && !LCDC.enabled)
+    {
+        // The scanline state machine is parked until the LCD is enabled
+        // again, so the screen only needs to be cleared once.
+        LY = 0x00;
+        STAT.mode = Mode::VBlankOrDisabled;
+
+        *framebuffer = { };
+        m_bus.sched.cancel(Event::PPUModeChange);
+    }
+    else if (!was_enabled && LCDC.enabled)
+    {
+        enter_mode(Mode::VBlankOrDisabled, m_bus.sched.timestamp);
+    }
+
     render_state.bg_tile_map     = LCDC.bg_tile_map ? 0x9C00 : 0x9800;
     render_state.window_tile_map = LCDC.window_tile_map ? 0x9C00 : 0x9800;
 
@@ -54,6 +115,13 @@ auto PPU::set_LCDC(const uint8_t data) noexcept -> void
     }
 }
 
+/// @brief Updates STAT, leaving the read-only mode bits intact.
+/// @param data The new STAT value.
+auto PPU::set_STAT(const uint8_t data) noexcept -> void
+{
+    STAT.byte = (data & ~0x03) | STAT.mode;
+}
+
 /// @brief Returns a byte from VRAM using an absolute memory address.
 /// @param index The absolute memory address.
 /// @return The byte from VRAM.
@@ -70,262 +138,455 @@ auto PPU::oam_access(const unsigned int index) noexcept -> uint8_t
     return oam[index - 0xFE00];
 }
 
-/// @brief Renders the current scanline.
-auto PPU::draw_scanline() noexcept -> void
+/// @brief Returns the colors a palette assigns to the color numbers.
+/// @param palette The palette to translate.
+/// @return The colors.
+auto PPU::palette_colors(const Palette palette) noexcept -> PaletteColors
 {
-    unsigned int offset_x;
-    unsigned int offset_y;
-    uint16_t tile_map;
-    uint16_t tile_data = render_state.bg_win_tile_data;
-
-    auto will_draw{ false };
-
-    if (LCDC.bg_enabled)
+    constexpr PaletteColors colors =
     {
-        offset_x = (SCX + screen_x) & 0xFF;
-        offset_y = (SCY + LY) & 0xFF;
-        tile_map = render_state.bg_tile_map;
+        Colors::White,
+        Colors::LightGray,
+        Colors::DarkGray,
+        Colors::Black
+    };
 
-        will_draw = true;
-    }
+    return { colors[palette.c0],
+             colors[palette.c1],
+             colors[palette.c2],
+             colors[palette.c3] };
+}
 
-    if (LCDC.window_enabled)
+/// @brief Decodes a tile to color numbers.
+/// @param tile The tile number, counting from $8000.
+auto PPU::decode_tile(const unsigned int tile) noexcept -> void
+{
+    for (unsigned int y{ 0 }; y < 8; ++y)
     {
-        const unsigned int m_WX = WX - 7;
+        const uint8_t lo{ vram[(tile * 16) + (y * 2)]     };
+        const uint8_t hi{ vram[(tile * 16) + (y * 2) + 1] };
 
-        if ((WY <= LY) && (screen_x >= m_WX))
+        for (unsigned int x{ 0 }; x < 8; ++x)
         {
-            offset_x = screen_x - m_WX;
-            offset_y = LY - WY;
-            tile_map = render_state.window_tile_map;
+            const unsigned int bit{ 7 - x };
 
-            will_draw = true;
+            tile_rows[(tile * 8) + y][x] =
+            static_cast<uint8_t>((((hi >> bit) & 1) << 1) | ((lo >> bit) & 1));
         }
     }
+    dirty_tiles.reset(tile);
+}
+
+/// @brief Returns a decoded row of tile data, decoding the tile first if it
+/// was changed since.
+/// @param tile The tile number, counting from $8000.
+/// @param row The row of the tile. Rows past the 8th continue into the
+/// following tiles, as 8x16 sprites do.
+/// @return The color numbers of the pixels, from left to right.
+auto PPU::tile_row(const unsigned int tile, const unsigned int row) noexcept
+-> const std::array<uint8_t, 8>&
+{
+    const unsigned int index{ (tile * 8) + row };
 
-    if (will_draw)
+    if (dirty_tiles[index / 8])
     {
-        const unsigned int row{ (offset_y / 8) * 32 };
-        const unsigned int col{ offset_x / 8 };
+        decode_tile(index / 8);
+    }
+    return tile_rows[index];
+}
 
-        const unsigned int index{ tile_map + row + col };
-            
-        if (!render_state.signed_tile_id)
-        {
-            const uint8_t tile_id{ vram_access(index) };
-            tile_data += tile_id * 16;
-        }
-        else
-        {
-            const int8_t tile_id{ static_cast<int8_t>(vram_access(index)) };
-            tile_data += (tile_id + 128) * 16;
-        }
+/// @brief Renders the current scanline.
+auto PPU::draw_scanline() noexcept -> void
+{
+    uint32_t* const line{ framebuffer->data() + (LY * SCREEN_X) };
 
-        const unsigned int line{ (offset_y % 8) * 2 };
-            
-        const uint8_t lo{ vram_access(tile_data + line)     };
-        const uint8_t hi{ vram_access(tile_data + line + 1) };
+    // Pixels left alone by the background and window count as color number 0
+    // when drawing sprites.
+    LineNumbers numbers{ };
 
-        pixel(lo, hi, 7 - (offset_x & 7), BGP, false);
+    // The pixel the window starts at, if it's on this line at all.
+    unsigned int window_x{ SCREEN_X };
+
+    if (LCDC.window_enabled && (WY <= LY))
+    {
+        window_x = std::min<unsigned int>(WX - 7, SCREEN_X);
     }
 
-    if (LCDC.sprites_enabled)
+    if (LCDC.bg_enabled)
     {
-        for (auto oam_address : oam_entries)
-        {
-            const uint8_t y = oam_access(oam_address + 0) - 16;
-            const uint8_t x = oam_access(oam_address + 1) - 8;
+        draw_tiles(line,
+                   numbers,
+                   0,
+                   window_x,
+                   render_state.bg_tile_map,
+                   SCX,
+                   (SCY + LY) & 0xFF);
+    }
 
-            if ((screen_x >= x) && (screen_x < (x + 8)))
-            {
-                const unsigned int x_pos = screen_x - x;
-                const unsigned int line = (LY - y) * 2;
+    if (window_x < SCREEN_X)
+    {
+        draw_tiles(line,
+                   numbers,
+                   window_x,
+                   SCREEN_X,
+                   render_state.window_tile_map,
+                   0,
+                   LY - WY);
+    }
 
-                const uint8_t tile  = oam_access(oam_address + 2);
-                const uint8_t flags = oam_access(oam_address + 3);
+    if (LCDC.sprites_enabled)
+    {
+        draw_sprites(line, numbers);
+    }
+}
 
-                const unsigned int address = 0x8000 + (tile * 16) + line;
+/// @brief Renders a part of the current scanline from a tile map.
+/// @param line The pixels of the current scanline.
+/// @param numbers Receives the color numbers of the pixels.
+/// @param begin The first pixel to render.
+/// @param end One past the last pixel to render.
+/// @param tile_map The beginning address of the tile map.
+/// @param x The X position in the tile map of the first pixel.
+/// @param y The Y position in the tile map of the scanline.
+auto PPU::draw_tiles(uint32_t* const line,
+                     LineNumbers& numbers,
+                     const unsigned int begin,
+                     const unsigned int end,
+                     const uint16_t tile_map,
+                     unsigned int x,
+                     const unsigned int y) noexcept -> void
+{
+    // The background and window have always been drawn with the bits of the
+    // tile data swapped, so color numbers 1 and 2 are too.
+    const PaletteColors bg_colors{ palette_colors(BGP) };
+    const PaletteColors colors{ bg_colors[0],
+                                bg_colors[2],
+                                bg_colors[1],
+                                bg_colors[3] };
+
+    const unsigned int map_row{ tile_map + ((y / 8) * 32) };
+    const unsigned int first_tile{ (render_state.bg_win_tile_data - 0x8000u)
+                                   / 16 };
+
+    // Whole tile rows are drawn to a buffer, starting with the one the first
+    // pixel is in, and the part wanted is copied to the line from there.
+    std::array<uint32_t, SCREEN_X + 16> buffer;
+    std::array<uint8_t, SCREEN_X + 16> number_buffer;
+
+    const unsigned int fine_x{ x % 8 };
+    const unsigned int tiles{ (fine_x + (end - begin) + 7) / 8 };
+
+    for (unsigned int n{ 0 }; n < tiles; ++n, x += 8)
+    {
+        const uint8_t tile_id{ vram_access(map_row + ((x & 0xFF) / 8)) };
 
-                const uint8_t lo{ vram_access(address)     };
-                const uint8_t hi{ vram_access(address + 1) };
+        const unsigned int tile{ render_state.signed_tile_id
+                               ? first_tile +
+                                 (static_cast<int8_t>(tile_id) + 128)
+                               : first_tile + tile_id };
 
-                Palette p;
+        const auto& pixels{ tile_row(tile, y % 8) };
 
-                if (flags & (1 << 4))
-                {
-                    p = OBP1;
-                }
-                else
-                {
-                    p = OBP0;
-                }
-                pixel(hi, lo, 7 - (x_pos & 7), p, true);
-            }
-        }
+        expand_row(buffer.data() + (n * 8), pixels, colors);
+        std::copy(pixels.begin(),
+                  pixels.end(),
+                  number_buffer.begin() + (n * 8));
     }
+
+    std::copy_n(buffer.begin() + fine_x, end - begin, line + begin);
+    std::copy_n(number_buffer.begin() + fine_x,
+                end - begin,
+                numbers.begin() + begin);
 }
 
-/// @brief Puts a pixel on the screen data.
-/// @param lo The low byte of the tile data.
-/// @param hi The high byte of the tile data.
-/// @param bit The pixel bit to use.
-/// @param palette The palette to use for color translation.
-/// @param sprite Ignore color 0 if `true`.
-auto PPU::pixel(const uint8_t hi,
-                const uint8_t lo,
-                const unsigned int bit,
-                const Palette palette,
-                const bool sprite) noexcept -> void
+/// @brief Renders the sprites found for the current scanline.
+/// @param line The pixels of the current scanline.
+/// @param bg_numbers The color numbers of the background and window pixels,
+/// which sprites can be drawn behind.
+auto PPU::draw_sprites(uint32_t* const line,
+                       const LineNumbers& bg_numbers) noexcept -> void
 {
-    const unsigned int p0{ (hi & (1 << bit)) != 0 };
-    const unsigned int p1{ (lo & (1 << bit)) != 0 };
+    if (oam_entry_count == 0)
+    {
+        return;
+    }
 
-    const unsigned int pixel{ (p0 << 1) | p1 };
+    // Bits of the sprite pixel masks.
+    constexpr uint8_t OPAQUE{ 1 << 0 };
+    constexpr uint8_t BEHIND_BG{ 1 << 1 };
 
-    constexpr std::array<enum Colors, 4> colors =
+    // The sprites are rasterized first, so that where they overlap, the pixel
+    // of the sprite with the highest priority is the one weighed against the
+    // background, even if it ends up hidden behind it.
+    std::array<uint32_t, SCREEN_X> sprite_line;
+    std::array<uint8_t, SCREEN_X> masks{ };
+
+    for (unsigned int entry{ 0 }; entry < oam_entry_count; ++entry)
     {
-        Colors::White,
-        Colors::LightGray,
-        Colors::DarkGray,
-        Colors::Black
-    };
+        const uint16_t oam_address{ oam_entries[entry] };
 
-    const unsigned int index{ (LY * SCREEN_X) + screen_x };
+        const uint8_t y = oam_access(oam_address + 0) - 16;
+        const uint8_t x = oam_access(oam_address + 1) - 8;
 
-    switch (pixel)
-    {
-        case 0:
-            if (!sprite)
+        const uint8_t tile  = oam_access(oam_address + 2);
+        const uint8_t flags = oam_access(oam_address + 3);
+
+        // The sprite was found on this line by the OAM search, but OAM may
+        // have been written to since.
+        const unsigned int row{ (LY - y) & 0x0Fu };
+
+        const auto& pixels{ tile_row(tile, row) };
+        const PaletteColors colors
+        {
+            palette_colors((flags & (1 << 4)) ? OBP1 : OBP0)
+        };
+
+        const uint8_t mask = OPAQUE | ((flags & (1 << 7)) ? BEHIND_BG : 0);
+
+        for (unsigned int pixel{ 0 }; pixel < 8; ++pixel)
+        {
+            const unsigned int screen{ x + pixel };
+
+            // Color number 0 is transparent.
+            if ((screen < SCREEN_X) && !masks[screen] && pixels[pixel])
             {
-                screen_data[index] = colors[palette.c0];
+                sprite_line[screen] = colors[pixels[pixel]];
+                masks[screen] = mask;
             }
-            return;
+        }
+    }
 
-        case 1:
-            screen_data[index] = colors[palette.c1];
-            return;
+    for (unsigned int screen{ 0 }; screen < SCREEN_X; ++screen)
+    {
+        const uint8_t mask{ masks[screen] };
 
-        case 2:
-            screen_data[index] = colors[palette.c2];
-            return;
+        // Sprites behind the background only show through its color 0.
+        if ((mask & OPAQUE) && !((mask & BEHIND_BG) && bg_numbers[screen]))
+        {
+            line[screen] = sprite_line[screen];
+        }
+    }
+}
 
-        case 3:
-            screen_data[index] = colors[palette.c3];
-            return;
+/// @brief Stores a byte into VRAM, marking the tile it belongs to as changed.
+/// @param address The absolute memory address.
+/// @param data The data to store at the address.
+auto PPU::vram_write(const uint16_t address, const uint8_t data) noexcept
+-> void
+{
+    const unsigned int index{ address - 0x8000u };
+
+    vram.write(index, data);
+
+    if (index < (TILES * 16))
+    {
+        dirty_tiles.set(index / 16);
     }
 }
 
+/// @brief Marks every tile as changed, i.e. because VRAM was replaced without
+/// going through `vram_write()`.
+auto PPU::vram_changed() noexcept -> void
+{
+    dirty_tiles.set();
+}
+
 /// @brief Resets the PPU to the startup state.
 auto PPU::reset() noexcept -> void
 {
+    // The registers are cleared as a whole before setting `byte`, so that
+    // the padding saved along with them is the same every time.
+    render_state = { };
+
+    LCDC = { };
     set_LCDC(0x91);
 
     SCX = 0x00;
     SCY = 0x00;
+    LY  = 0x00;
+
+    BGP = { };
     BGP.byte = 0xFC;
 
-    STAT.byte = 0x00;
+    OBP0 = { };
+    OBP1 = { };
+
+    STAT = { };
 
     WY = 0x00;
     WX = 0x00;
 
-    oam_entries.clear();
+    oam = { };
+    oam_entry_count = 0;
 
-    ly_counter = 0;
-    screen_x = 0;
+    vram.clear();
+    vram_changed();
 
-    vram        = { };
-    screen_data = { };
+    *framebuffer = { };
+
+    render_progress.frames_skipped = 0;
+    render_progress.frame_requested = false;
+    begin_frame();
+
+    enter_mode(Mode::HBlank, m_bus.sched.timestamp);
 }
 
-/// @brief Advances the PPU by 1 m-cycle.
-auto PPU::step() noexcept -> void
+/// @brief Saves or loads the state of the PPU.
+///
+/// The frame being rendered is output for the host, and isn't part of the
+/// state.
+/// @param state The save state serializer.
+auto PPU::serialize(StateSerializer& state) noexcept -> void
 {
-    // We do nothing if the PPU isn't enabled.
-    if (!LCDC.enabled)
+    state.field(SCY);
+    state.field(SCX);
+    state.field(LY);
+    state.field(STAT);
+    state.field(BGP);
+    state.field(OBP0);
+    state.field(OBP1);
+    state.field(WY);
+    state.field(WX);
+    vram.serialize(state);
+    state.field(oam);
+    state.field(LCDC);
+    state.field(render_state);
+
+    // The sprites found for the current line, already sorted by priority,
+    // stored in a fixed number of slots so that the size of the state doesn't
+    // depend on them.
+    std::array<uint16_t, MAX_SPRITES_PER_LINE> sprites{ };
+    uint8_t count{ static_cast<uint8_t>(oam_entry_count) };
+
+    std::copy_n(oam_entries.begin(), oam_entry_count, sprites.begin());
+
+    state.field(count);
+    state.field(sprites);
+
+    if (state.loading())
     {
-        LY = 0x00;
-
-        STAT.mode = Mode::VBlankOrDisabled;
+        vram_changed();
 
-        screen_data = { };
-        ly_counter = 0;
-
-        return;
+        oam_entry_count = std::min<uint8_t>(count, MAX_SPRITES_PER_LINE);
+        oam_entries = sprites;
     }
+}
 
-    ly_counter += 4;
+/// @brief Enters a mode and schedules its end.
+/// @param mode The mode to enter.
+/// @param timestamp The timestamp the mode begins at.
+auto PPU::enter_mode(const Mode mode, const uint64_t timestamp) noexcept
+-> void
+{
+    STAT.mode = mode;
+    m_bus.sched.schedule_at(Event::PPUModeChange,
+                            timestamp + mode_cycles[mode]);
+}
 
+/// @brief Advances the scanline state machine to the next mode.
+/// @param timestamp The timestamp the current mode ended at.
+auto PPU::step(const uint64_t timestamp) noexcept -> void
+{
     switch (STAT.mode)
     {
         case Mode::HBlank:
-            if (ly_counter == 204)
-            {
-                LY++;
+            LY++;
 
-                if (LY == 144)
-                {
-                    m_bus.irq(Interrupt::VBlankInterrupt);
-                    STAT.mode = Mode::VBlankOrDisabled;
-                }
-                else
-                {
-                    STAT.mode = Mode::OAMSearch;
-                }
-                ly_counter = 0;
+            if (LY == 144)
+            {
+                m_bus.irq(Interrupt::VBlankInterrupt);
+                enter_mode(Mode::VBlankOrDisabled, timestamp);
+            }
+            else
+            {
+                enter_mode(Mode::OAMSearch, timestamp);
             }
             break;
 
         case Mode::VBlankOrDisabled:
-            if (ly_counter == 456)
-            {
-                LY++;
+            LY++;
 
-                if (LY == 154)
-                {
-                    STAT.mode = Mode::OAMSearch;
-                    LY   = 0;
-                }
-                ly_counter = 0;
+            if (LY == 154)
+            {
+                LY = 0;
+                begin_frame();
+                enter_mode(Mode::OAMSearch, timestamp);
+            }
+            else
+            {
+                enter_mode(Mode::VBlankOrDisabled, timestamp);
             }
             break;
 
         case Mode::OAMSearch:
-            if (ly_counter == 80)
+            for (uint16_t index{ 0xFE00 }; (index < 0xFEA0) &&
+                 (oam_entry_count < MAX_SPRITES_PER_LINE); index += 4)
             {
-                for (auto index{ 0xFE00 },
-                     sprites_found = 0; index < 0xFEA0; index += 4)
-                {
-                    const uint8_t y = oam_access(index + 0) - 16;
+                const uint8_t y = oam_access(index + 0) - 16;
 
-                    if ((LY >= y) && (LY < (y + render_state.sprite_size)))
+                if ((LY >= y) && (LY < (y + render_state.sprite_size)))
+                {
+                    // Sorted by X position as they're found, after any
+                    // sprites at the same position found earlier.
+                    const uint8_t x{ oam_access(index + 1) };
+                    unsigned int entry{ oam_entry_count++ };
+
+                    for (; (entry > 0) &&
+                           (oam_access(oam_entries[entry - 1] + 1) > x);
+                         --entry)
                     {
-                        oam_entries.push_back(index);
-
-                        if (++sprites_found == 10)
-                        {
-                            break;
-                        }
+                        oam_entries[entry] = oam_entries[entry - 1];
                     }
+                    oam_entries[entry] = index;
                 }
-                STAT.mode = Mode::Drawing;
-                ly_counter = 0;
             }
+            enter_mode(Mode::Drawing, timestamp);
             break;
 
         case Mode::Drawing:
-            if (ly_counter == 172)
+            if (render_progress.rendering)
             {
-                for (; screen_x < SCREEN_X; ++screen_x)
-                {
-                    draw_scanline();
-                }
-
-                oam_entries.clear();
-                screen_x = 0;
-                ly_counter = 0;
-                STAT.mode = Mode::HBlank;
+                draw_scanline();
             }
+
+            oam_entry_count = 0;
+            enter_mode(Mode::HBlank, timestamp);
             break;
     }
 }
+
+/// @brief Requests the next frame to be rendered, with
+/// `RenderPolicy::OnRequest`. The frame being drawn is left as is.
+auto PPU::request_frame() noexcept -> void
+{
+    render_progress.frame_requested = true;
+}
+
+/// @brief Decides whether or not the frame starting is rendered.
+auto PPU::begin_frame() noexcept -> void
+{
+    switch (render_policy)
+    {
+        case RenderPolicy::All:
+            render_progress.rendering = true;
+            return;
+
+        case RenderPolicy::EveryNth:
+            render_progress.rendering = (render_progress.frames_skipped == 0);
+
+            if (++render_progress.frames_skipped >= render_interval)
+            {
+                render_progress.frames_skipped = 0;
+            }
+            return;
+
+        case RenderPolicy::OnRequest:
+            render_progress.rendering = render_progress.frame_requested;
+            render_progress.frame_requested = false;
+            return;
+
+        case RenderPolicy::Never:
+            render_progress.rendering = false;
+            return;
+    }
+}
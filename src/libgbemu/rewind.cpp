@@ -0,0 +1,389 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <algorithm>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "gb.h"
+#include "rewind.h"
+
+using namespace GameBoy;
+
+// A delta is encoded as a sequence of runs, each made up of:
+//
+// * The number of unchanged blocks (16-bit);
+// * The number of changed blocks that follow (16-bit);
+// * The XOR of every changed block.
+//
+// Most of a state stays the same from one frame to the next, so most of a
+// delta is squeezed out as unchanged blocks. Blocks are compared and XORed 16
+// bytes at a time with SSE2 where available.
+
+/// @brief The size of a block, in bytes.
+constexpr std::size_t BLOCK_SIZE{ 16 };
+
+/// @brief The maximum number of blocks in a run.
+constexpr unsigned int MAX_RUN{ 0xFFFF };
+
+/// @brief The size of a run header, in bytes.
+constexpr std::size_t RUN_HEADER_SIZE{ 4 };
+
+/// @brief The size of the sizes stored on either side of a delta, in bytes.
+constexpr std::size_t DELTA_SIZE_SIZE{ sizeof(uint32_t) };
+
+#ifdef __SSE2__
+/// @brief A block, held in a register.
+using Block = __m128i;
+
+/// @brief Returns the XOR of two blocks.
+/// @param a The first block.
+/// @param b The second block.
+/// @return The XOR of the two blocks.
+static inline auto xor_blocks(const uint8_t* a, const uint8_t* b) noexcept
+-> Block
+{
+    return _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const Block*>(a)),
+                         _mm_loadu_si128(reinterpret_cast<const Block*>(b)));
+}
+
+/// @brief Determines if a block is all zeroes.
+/// @param block The block.
+/// @return `true` if the block is all zeroes, or `false` otherwise.
+static inline auto is_zero(const Block block) noexcept -> bool
+{
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_setzero_si128())) ==
+           0xFFFF;
+}
+
+/// @brief Stores a block.
+/// @param data Receives the block.
+/// @param block The block.
+static inline auto store_block(uint8_t* data, const Block block) noexcept
+-> void
+{
+    _mm_storeu_si128(reinterpret_cast<Block*>(data), block);
+}
+#else
+/// @brief A block, held in a pair of 64-bit integers.
+struct Block
+{
+    uint64_t lo;
+    uint64_t hi;
+};
+
+/// @brief Returns the XOR of two blocks.
+/// @param a The first block.
+/// @param b The second block.
+/// @return The XOR of the two blocks.
+static inline auto xor_blocks(const uint8_t* a, const uint8_t* b) noexcept
+-> Block
+{
+    Block x;
+    Block y;
+
+    std::memcpy(&x, a, BLOCK_SIZE);
+    std::memcpy(&y, b, BLOCK_SIZE);
+
+    return { x.lo ^ y.lo, x.hi ^ y.hi };
+}
+
+/// @brief Determines if a block is all zeroes.
+/// @param block The block.
+/// @return `true` if the block is all zeroes, or `false` otherwise.
+static inline auto is_zero(const Block block) noexcept -> bool
+{
+    return (block.lo | block.hi) == 0;
+}
+
+/// @brief Stores a block.
+/// @param data Receives the block.
+/// @param block The block.
+static inline auto store_block(uint8_t* data, const Block block) noexcept
+-> void
+{
+    std::memcpy(data, &block, BLOCK_SIZE);
+}
+#endif
+
+/// @brief Encodes the delta between two states.
+/// @param next The newer state.
+/// @param previous The older state.
+/// @param blocks The size of the states, in blocks.
+/// @param delta Receives the delta.
+/// @return The size of the delta, in bytes.
+static auto encode(const uint8_t* next,
+                   const uint8_t* previous,
+                   const std::size_t blocks,
+                   uint8_t* delta) noexcept -> std::size_t
+{
+    uint8_t* out{ delta };
+    std::size_t block{ 0 };
+
+    while (block < blocks)
+    {
+        uint8_t* const header{ out };
+        out += RUN_HEADER_SIZE;
+
+        uint16_t unchanged{ 0 };
+        uint16_t changed{ 0 };
+
+        for (; (block < blocks) && (unchanged < MAX_RUN); ++block)
+        {
+            const std::size_t offset{ block * BLOCK_SIZE };
+
+            if (!is_zero(xor_blocks(&next[offset], &previous[offset])))
+            {
+                break;
+            }
+            unchanged++;
+        }
+
+        for (; (block < blocks) && (changed < MAX_RUN); ++block)
+        {
+            const std::size_t offset{ block * BLOCK_SIZE };
+            const Block x{ xor_blocks(&next[offset], &previous[offset]) };
+
+            if (is_zero(x))
+            {
+                break;
+            }
+
+            store_block(out, x);
+            out += BLOCK_SIZE;
+
+            changed++;
+        }
+
+        std::memcpy(&header[0], &unchanged, sizeof(unchanged));
+        std::memcpy(&header[2], &changed, sizeof(changed));
+    }
+    return out - delta;
+}
+
+/// @brief Applies a delta to a state, turning it into the state it was
+/// encoded against.
+/// @param state The state.
+/// @param delta The delta.
+/// @param size The size of the delta, in bytes.
+static auto decode(uint8_t* state,
+                   const uint8_t* delta,
+                   const std::size_t size) noexcept -> void
+{
+    const uint8_t* in{ delta };
+    const uint8_t* const end{ delta + size };
+
+    std::size_t offset{ 0 };
+
+    while (in < end)
+    {
+        uint16_t unchanged;
+        uint16_t changed;
+
+        std::memcpy(&unchanged, &in[0], sizeof(unchanged));
+        std::memcpy(&changed, &in[2], sizeof(changed));
+        in += RUN_HEADER_SIZE;
+
+        offset += unchanged * BLOCK_SIZE;
+
+        for (unsigned int i{ 0 }; i < changed; ++i)
+        {
+            store_block(&state[offset], xor_blocks(&state[offset], in));
+
+            in += BLOCK_SIZE;
+            offset += BLOCK_SIZE;
+        }
+    }
+}
+
+/// @brief Initializes a rewind buffer.
+///
+/// The size of the states is taken from the system as it is now, so a new
+/// buffer must be created whenever a different cartridge is loaded.
+/// @param system The system to take states of.
+/// @param budget The number of bytes to store the states before the most
+/// recent one in.
+RewindBuffer::RewindBuffer(System& system, const std::size_t budget) :
+m_system(system), m_head(0), m_tail(0), m_deltas(0), m_has_current(false)
+{
+    m_state_size = m_system.state_size();
+
+    const std::size_t blocks{ (m_state_size + BLOCK_SIZE - 1) / BLOCK_SIZE };
+
+    // The padding is never written to, so it never shows up in a delta.
+    m_current.resize(blocks * BLOCK_SIZE);
+    m_next.resize(blocks * BLOCK_SIZE);
+
+    // Every block changed, with a run header for every `MAX_RUN` blocks.
+    m_scratch.resize((blocks * BLOCK_SIZE) +
+                     (((blocks / MAX_RUN) + 1) * RUN_HEADER_SIZE));
+
+    m_ring.resize(std::max<std::size_t>(budget, 1));
+}
+
+/// @brief Takes a state of the system, and adds it to the history.
+auto RewindBuffer::push() noexcept -> void
+{
+    if (m_system.save_state(m_next.data(), m_state_size) == 0)
+    {
+        return;
+    }
+
+    if (m_has_current)
+    {
+        const std::size_t size{ encode(m_next.data(),
+                                       m_current.data(),
+                                       m_current.size() / BLOCK_SIZE,
+                                       m_scratch.data()) };
+
+        // A delta too large for the ring buffer breaks the chain back to
+        // the older states, so they're of no use anymore.
+        if (!store(size))
+        {
+            m_head = 0;
+            m_tail = 0;
+            m_deltas = 0;
+        }
+    }
+
+    m_current.swap(m_next);
+    m_has_current = true;
+}
+
+/// @brief Loads the most recent state of the history into the system, and
+/// removes it from the history.
+/// @return `true` if a state was loaded, or `false` if the history is empty.
+auto RewindBuffer::rewind() noexcept -> bool
+{
+    if (!m_has_current)
+    {
+        return false;
+    }
+
+    m_system.load_state(m_current.data(), m_state_size);
+
+    if (m_deltas == 0)
+    {
+        m_has_current = false;
+        return true;
+    }
+
+    uint32_t size;
+    ring_read(m_head - DELTA_SIZE_SIZE,
+              reinterpret_cast<uint8_t*>(&size),
+              sizeof(size));
+
+    ring_read(m_head - DELTA_SIZE_SIZE - size, m_scratch.data(), size);
+    decode(m_current.data(), m_scratch.data(), size);
+
+    m_head -= size + (2 * DELTA_SIZE_SIZE);
+    m_deltas--;
+
+    return true;
+}
+
+/// @brief Removes every state from the history.
+auto RewindBuffer::clear() noexcept -> void
+{
+    m_head = 0;
+    m_tail = 0;
+    m_deltas = 0;
+    m_has_current = false;
+}
+
+/// @brief Returns the number of states in the history.
+/// @return The number of states.
+auto RewindBuffer::size() const noexcept -> std::size_t
+{
+    return m_has_current ? m_deltas + 1 : 0;
+}
+
+/// @brief Returns the number of bytes of the ring buffer in use.
+/// @return The number of bytes.
+auto RewindBuffer::used() const noexcept -> std::size_t
+{
+    return static_cast<std::size_t>(m_head - m_tail);
+}
+
+/// @brief Stores an encoded delta as the most recent one, discarding the
+/// oldest ones until it fits.
+/// @param size The size of the delta in `m_scratch`.
+/// @return `true` if the delta was stored, or `false` if it doesn't fit in the
+/// ring buffer at all.
+auto RewindBuffer::store(const std::size_t size) noexcept -> bool
+{
+    const std::size_t total{ size + (2 * DELTA_SIZE_SIZE) };
+
+    if (total > m_ring.size())
+    {
+        return false;
+    }
+
+    while ((used() + total) > m_ring.size())
+    {
+        uint32_t oldest;
+        ring_read(m_tail, reinterpret_cast<uint8_t*>(&oldest), sizeof(oldest));
+
+        m_tail += oldest + (2 * DELTA_SIZE_SIZE);
+        m_deltas--;
+    }
+
+    const auto size32{ static_cast<uint32_t>(size) };
+
+    ring_write(m_head, reinterpret_cast<const uint8_t*>(&size32),
+               sizeof(size32));
+    ring_write(m_head + DELTA_SIZE_SIZE, m_scratch.data(), size);
+    ring_write(m_head + DELTA_SIZE_SIZE + size,
+               reinterpret_cast<const uint8_t*>(&size32),
+               sizeof(size32));
+
+    m_head += total;
+    m_deltas++;
+
+    return true;
+}
+
+/// @brief Copies bytes into the ring buffer, wrapping around its end.
+/// @param position The position to copy to, before wrapping.
+/// @param data The bytes to copy.
+/// @param size The number of bytes.
+auto RewindBuffer::ring_write(const uint64_t position,
+                              const uint8_t* data,
+                              const std::size_t size) noexcept -> void
+{
+    const std::size_t offset{ static_cast<std::size_t>(position %
+                                                       m_ring.size()) };
+    const std::size_t first{ std::min(size, m_ring.size() - offset) };
+
+    std::memcpy(&m_ring[offset], data, first);
+    std::memcpy(&m_ring[0], data + first, size - first);
+}
+
+/// @brief Copies bytes out of the ring buffer, wrapping around its end.
+/// @param position The position to copy from, before wrapping.
+/// @param data Receives the bytes.
+/// @param size The number of bytes.
+auto RewindBuffer::ring_read(const uint64_t position,
+                             uint8_t* data,
+                             const std::size_t size) const noexcept -> void
+{
+    const std::size_t offset{ static_cast<std::size_t>(position %
+                                                       m_ring.size()) };
+    const std::size_t first{ std::min(size, m_ring.size() - offset) };
+
+    std::memcpy(data, &m_ring[offset], first);
+    std::memcpy(data + first, &m_ring[0], size - first);
+}
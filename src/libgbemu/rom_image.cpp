@@ -0,0 +1,232 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <fmt/printf.h>
+#include "rom_image.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace GameBoy;
+
+/// @brief Guards `open_images`.
+static std::mutex open_images_mutex;
+
+/// @brief The images opened from files, keyed by the identity of the file.
+static std::map<std::string, std::weak_ptr<const RomImage>> open_images;
+
+RomImage::RomImage() noexcept : m_data(nullptr), m_size(0), m_mapping(nullptr)
+{ }
+
+/// @brief Unmaps the file, if any.
+RomImage::~RomImage() noexcept
+{
+    if (!m_mapping)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_mapping);
+#else
+    munmap(m_mapping, m_size);
+#endif
+}
+
+/// @brief Opens a ROM image from a file, or returns the image of the file if
+/// it is already open.
+///
+/// This function will throw an `std::runtime_error` if the file could not be
+/// opened or mapped.
+/// @param path The path of the file.
+/// @return The image.
+auto RomImage::open(const std::string& path) -> std::shared_ptr<const RomImage>
+{
+    std::shared_ptr<RomImage> image{ new RomImage() };
+
+#ifdef _WIN32
+    const HANDLE file{ CreateFileA(path.c_str(),
+                                   GENERIC_READ,
+                                   FILE_SHARE_READ,
+                                   nullptr,
+                                   OPEN_EXISTING,
+                                   FILE_ATTRIBUTE_NORMAL,
+                                   nullptr) };
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        throw std::runtime_error(fmt::sprintf("Unable to open %s", path));
+    }
+
+    BY_HANDLE_FILE_INFORMATION info;
+
+    if (!GetFileInformationByHandle(file, &info))
+    {
+        CloseHandle(file);
+        throw std::runtime_error(fmt::sprintf("Unable to open %s", path));
+    }
+
+    const unsigned long long size
+    {
+        (static_cast<unsigned long long>(info.nFileSizeHigh) << 32) |
+        info.nFileSizeLow
+    };
+
+    // As on other systems, the file is identified by its volume and index
+    // rather than by the path, along with its size and last write time.
+    const std::string key{ fmt::sprintf("%lu:%lu:%lu:%llu:%lu:%lu",
+                           info.dwVolumeSerialNumber,
+                           info.nFileIndexHigh,
+                           info.nFileIndexLow,
+                           size,
+                           info.ftLastWriteTime.dwHighDateTime,
+                           info.ftLastWriteTime.dwLowDateTime) };
+
+    std::lock_guard<std::mutex> lock{ open_images_mutex };
+
+    if (auto open_image{ open_images[key].lock() })
+    {
+        CloseHandle(file);
+        return open_image;
+    }
+
+    if (size > 0)
+    {
+        const HANDLE mapping{ CreateFileMappingA(file,
+                                                 nullptr,
+                                                 PAGE_READONLY,
+                                                 0,
+                                                 0,
+                                                 nullptr) };
+
+        // The view keeps the mapping open on its own.
+        if (mapping)
+        {
+            image->m_mapping = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+
+        if (!image->m_mapping)
+        {
+            throw std::runtime_error(fmt::sprintf("Unable to map %s", path));
+        }
+        image->m_size = static_cast<std::size_t>(size);
+    }
+    else
+    {
+        CloseHandle(file);
+    }
+#else
+    const int file{ ::open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+
+    if (file == -1)
+    {
+        throw std::runtime_error(fmt::sprintf("Unable to open %s: %s",
+                                              path,
+                                              std::strerror(errno)));
+    }
+
+    struct stat info;
+
+    if (fstat(file, &info) == -1)
+    {
+        const int error{ errno };
+        close(file);
+
+        throw std::runtime_error(fmt::sprintf("Unable to open %s: %s",
+                                              path,
+                                              std::strerror(error)));
+    }
+
+    // The same file can be reached through any number of paths, and the
+    // modification time keeps an image of a file since rewritten from being
+    // handed out.
+    const std::string key{ fmt::sprintf("%llu:%llu:%lld:%lld",
+                           static_cast<unsigned long long>(info.st_dev),
+                           static_cast<unsigned long long>(info.st_ino),
+                           static_cast<long long>(info.st_size),
+                           static_cast<long long>(info.st_mtime)) };
+
+    std::lock_guard<std::mutex> lock{ open_images_mutex };
+
+    if (auto open_image{ open_images[key].lock() })
+    {
+        close(file);
+        return open_image;
+    }
+
+    if (info.st_size > 0)
+    {
+        const auto size{ static_cast<std::size_t>(info.st_size) };
+        void* const region{ mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0) };
+
+        const int error{ errno };
+        close(file);
+
+        if (region == MAP_FAILED)
+        {
+            throw std::runtime_error(fmt::sprintf("Unable to map %s: %s",
+                                                  path,
+                                                  std::strerror(error)));
+        }
+
+        image->m_mapping = region;
+        image->m_size = size;
+    }
+    else
+    {
+        close(file);
+    }
+#endif
+
+    image->m_data = static_cast<const uint8_t*>(image->m_mapping);
+
+    // Drop the entries of images that no longer exist while we're here.
+    for (auto entry{ open_images.begin() }; entry != open_images.end();)
+    {
+        entry = entry->second.expired() ? open_images.erase(entry)
+                                        : std::next(entry);
+    }
+
+    open_images[key] = image;
+    return image;
+}
+
+/// @brief Creates a ROM image from data already in memory.
+/// @param data The data, which is moved into the image.
+/// @return The image.
+auto RomImage::from_data(std::vector<uint8_t> data)
+-> std::shared_ptr<const RomImage>
+{
+    std::shared_ptr<RomImage> image{ new RomImage() };
+
+    image->m_owned = std::move(data);
+    image->m_data = image->m_owned.data();
+    image->m_size = image->m_owned.size();
+
+    return image;
+}
@@ -0,0 +1,82 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include "gb.h"
+#include "run_ahead.h"
+
+using namespace GameBoy;
+
+/// @brief Initializes a run-ahead frame runner.
+/// @param system The system to run.
+RunAhead::RunAhead(System& system) noexcept : m_system(system),
+                                               m_frame{ },
+                                               m_ahead(false)
+{ }
+
+/// @brief Executes a frame through `System::run_frame()`, then runs ahead of
+/// it to render the frame to present.
+///
+/// The speculative frames are rendered into a frame of their own, and the
+/// audio samples generated during them are discarded, as is their progress
+/// through the render policy, so the system ends up exactly as
+/// `System::run_frame()` alone would have left it.
+/// @param frames The number of frames to run ahead by, 0 to present the frame
+/// the system rendered.
+/// @return The number of T-cycles taken by the frame executed, not counting
+/// the speculative frames.
+auto RunAhead::run_frame(const unsigned int frames) noexcept -> unsigned int
+{
+    PPU& ppu{ m_system.bus.ppu };
+
+    const unsigned int cycles{ m_system.run_frame() };
+    m_ahead = frames != 0;
+
+    if (!m_ahead)
+    {
+        return cycles;
+    }
+
+    // The size of a state depends on the cartridge, which may have changed
+    // since the last frame. This only allocates when it grows.
+    m_state.resize(m_system.state_size());
+    m_system.save_state(m_state.data(), m_state.size());
+
+    ScreenData* const framebuffer{ ppu.framebuffer };
+    const std::size_t samples{ m_system.bus.apu.samples.size() };
+    const PPU::RenderProgress render_progress{ ppu.render_progress };
+
+    ppu.framebuffer = &m_frame;
+
+    for (unsigned int frame{ 0 }; frame < frames; ++frame)
+    {
+        m_system.run_frame();
+    }
+
+    ppu.framebuffer = framebuffer;
+    m_system.bus.apu.samples.resize(samples);
+
+    m_system.load_state(m_state.data(), m_state.size());
+    ppu.render_progress = render_progress;
+
+    return cycles;
+}
+
+/// @brief Returns the frame to present after `run_frame()`.
+/// @return The last speculative frame, or the frame the system rendered if it
+/// didn't run ahead.
+auto RunAhead::frame() const noexcept -> const ScreenData&
+{
+    return m_ahead ? m_frame : *m_system.bus.ppu.framebuffer;
+}
@@ -12,12 +12,118 @@
 // OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
 // CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
+#include <limits>
 #include "scheduler.h"
+#include "state.h"
 
 using namespace GameBoy;
 
+/// @brief The deadline of an event that is not pending.
+constexpr auto NOT_PENDING{ std::numeric_limits<uint64_t>::max() };
+
+/// @brief Initializes the scheduler.
+Scheduler::Scheduler() noexcept
+{
+    reset();
+}
+
 /// @brief Resets the scheduler to the startup state.
 auto Scheduler::reset() noexcept -> void
 {
     cpu_clock = 4194304;
+    timestamp = 0;
+
+    deadlines.fill(NOT_PENDING);
+    next_deadline = NOT_PENDING;
+}
+
+/// @brief Saves or loads the state of the scheduler.
+///
+/// Every pending event is part of the state, along with the timestamp it is
+/// due at.
+/// @param state The save state serializer.
+auto Scheduler::serialize(StateSerializer& state) noexcept -> void
+{
+    state.field(timestamp);
+    state.field(cpu_clock);
+    state.field(deadlines);
+    state.field(next_deadline);
+}
+
+/// @brief Schedules an event relative to the current timestamp.
+/// @param event The event to schedule.
+/// @param delay The number of T-cycles from now the event is due.
+auto Scheduler::schedule(const Event event, const uint64_t delay) noexcept
+-> void
+{
+    schedule_at(event, timestamp + delay);
+}
+
+/// @brief Schedules an event at an absolute timestamp.
+/// @param event The event to schedule.
+/// @param timestamp The timestamp the event is due at.
+auto Scheduler::schedule_at(const Event event,
+                            const uint64_t timestamp) noexcept -> void
+{
+    deadlines[static_cast<unsigned int>(event)] = timestamp;
+    update_next_deadline();
+}
+
+/// @brief Removes an event from the queue, if it is pending.
+/// @param event The event to remove.
+auto Scheduler::cancel(const Event event) noexcept -> void
+{
+    deadlines[static_cast<unsigned int>(event)] = NOT_PENDING;
+    update_next_deadline();
+}
+
+/// @brief Returns the number of T-cycles until the next event is due.
+/// @return 0 if an event is already due, or the number of T-cycles.
+auto Scheduler::until_next_event() const noexcept -> uint64_t
+{
+    return due() ? 0 : next_deadline - timestamp;
+}
+
+/// @brief Removes the earliest event that is due from the queue.
+/// @param timestamp Receives the timestamp the event was due at.
+/// @return The event, or `Event::None` if no event is due.
+auto Scheduler::pop_due(uint64_t& timestamp) noexcept -> Event
+{
+    if (!due())
+    {
+        return Event::None;
+    }
+
+    // Ties are broken in favor of the event type listed first, which is what
+    // makes the dispatch order deterministic.
+    unsigned int earliest{ 0 };
+
+    for (unsigned int index{ 1 }; index < deadlines.size(); ++index)
+    {
+        if (deadlines[index] < deadlines[earliest])
+        {
+            earliest = index;
+        }
+    }
+
+    timestamp = deadlines[earliest];
+
+    deadlines[earliest] = NOT_PENDING;
+    update_next_deadline();
+
+    return static_cast<Event>(earliest);
+}
+
+/// @brief Recalculates the earliest deadline of all pending events.
+auto Scheduler::update_next_deadline() noexcept -> void
+{
+    next_deadline = NOT_PENDING;
+
+    for (const auto deadline : deadlines)
+    {
+        if (deadline < next_deadline)
+        {
+            next_deadline = deadline;
+        }
+    }
 }
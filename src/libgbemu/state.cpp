@@ -0,0 +1,83 @@
+// Copyright 2020 Michael Rodriguez
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS.IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#include "state.h"
+
+using namespace GameBoy;
+
+/// @brief Initializes a serializer measuring the size of a state.
+/// @param memory Include the memory shared between forked systems?
+StateSerializer::StateSerializer(const bool memory) noexcept :
+m_mode(Mode::Measure), m_data(nullptr), m_size(0), m_offset(0),
+m_memory(memory)
+{ }
+
+/// @brief Initializes a serializer saving a state.
+/// @param data The buffer to save the state to.
+/// @param size The size of the buffer.
+/// @param memory Include the memory shared between forked systems?
+StateSerializer::StateSerializer(uint8_t* data,
+                                 const std::size_t size,
+                                 const bool memory) noexcept :
+m_mode(Mode::Save), m_data(data), m_size(size), m_offset(0), m_memory(memory)
+{ }
+
+/// @brief Initializes a serializer loading a state.
+/// @param data The buffer to load the state from. It is never written to.
+/// @param size The size of the buffer.
+/// @param memory Include the memory shared between forked systems?
+StateSerializer::StateSerializer(const uint8_t* data,
+                                 const std::size_t size,
+                                 const bool memory) noexcept :
+m_mode(Mode::Load), m_data(const_cast<uint8_t*>(data)), m_size(size),
+m_offset(0), m_memory(memory)
+{ }
+
+/// @brief Determines if a state is being loaded.
+/// @return `true` if a state is being loaded, or `false` otherwise.
+auto StateSerializer::loading() const noexcept -> bool
+{
+    return m_mode == Mode::Load;
+}
+
+/// @brief Determines if a state is being saved.
+/// @return `true` if a state is being saved, or `false` otherwise.
+auto StateSerializer::saving() const noexcept -> bool
+{
+    return m_mode == Mode::Save;
+}
+
+/// @brief Returns the number of bytes passed through so far.
+/// @return The number of bytes.
+auto StateSerializer::offset() const noexcept -> std::size_t
+{
+    return m_offset;
+}
+
+/// @brief Determines if the buffer was too small for the fields passed
+/// through. Fields past the end are left untouched.
+/// @return `true` if the buffer was too small, or `false` otherwise.
+auto StateSerializer::overflowed() const noexcept -> bool
+{
+    return (m_mode != Mode::Measure) && (m_offset > m_size);
+}
+
+/// @brief Determines if the memory shared between forked systems, i.e.
+/// `CowMemory`, is part of the state.
+/// @return `true` if the memory is included, or `false` if it is left out.
+auto StateSerializer::memory() const noexcept -> bool
+{
+    return m_memory;
+}
@@ -13,6 +13,7 @@
 // CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #include "bus.h"
+#include "state.h"
 #include "timer.h"
 
 using namespace GameBoy;
@@ -23,49 +24,154 @@ Timer::Timer(SystemBus& m_bus) noexcept : bus(m_bus)
 /// @brief Resets the timer to the startup state.
 auto Timer::reset() noexcept -> void
 {
+    DIV  = 0x00;
     TIMA = 0x00;
     TMA  = 0x00;
 
-    TAC.byte = 0x00;
+    // The whole register is cleared rather than just `byte`, as it is saved
+    // as is.
+    TAC = { };
 
     div_counter = 0;
     tima_counter = 0;
+
+    last_sync = bus.sched.timestamp;
+    bus.sched.cancel(Event::TimerOverflow);
 }
 
-/// @brief Advances the timer by 1 m-cycle.
-auto Timer::step() noexcept -> void
+/// @brief Saves or loads the state of the timer.
+/// @param state The save state serializer.
+auto Timer::serialize(StateSerializer& state) noexcept -> void
+{
+    state.field(DIV);
+    state.field(TIMA);
+    state.field(TMA);
+    state.field(TAC);
+    state.field(div_counter);
+    state.field(tima_counter);
+    state.field(last_sync);
+}
+
+/// @brief Brings the timer up to date with the current timestamp.
+auto Timer::sync() noexcept -> void
 {
-    div_counter += 4;
+    const auto elapsed{ bus.sched.timestamp - last_sync };
+    last_sync = bus.sched.timestamp;
+
+    const uint64_t div_total{ div_counter + elapsed };
 
-    if (div_counter == 256)
+    DIV += static_cast<uint8_t>(div_total / 256);
+    div_counter = div_total % 256;
+
+    if (!TAC.active)
     {
-        DIV++;
-        div_counter = 0;
+        return;
     }
 
-    if (TAC.active)
-    {
-        tima_counter += 4;
+    const uint64_t tima_total{ tima_counter + elapsed };
+    auto ticks{ tima_total / threshold() };
 
-        unsigned int threshold{ 0 };
+    tima_counter = tima_total % threshold();
 
-        switch (TAC.input_clock)
-        {
-            case 0: threshold = 1024; break;
-            case 1: threshold = 16;   break;
-            case 2: threshold = 64;   break;
-            case 3: threshold = 256;  break;
-        }
+    while (ticks != 0)
+    {
+        const unsigned int until_overflow{ 0x100u - TIMA };
 
-        while (tima_counter >= threshold)
+        if (ticks < until_overflow)
         {
-            if (TIMA == 0xFF)
-            {
-                bus.irq(Interrupt::TimerInterrupt);
-                TIMA = TMA;
-            }
-            TIMA++;
-            tima_counter -= threshold;
+            TIMA += static_cast<uint8_t>(ticks);
+            break;
         }
+
+        ticks -= until_overflow;
+
+        bus.irq(Interrupt::TimerInterrupt);
+        TIMA = TMA + 1;
+    }
+}
+
+/// @brief Handles a TIMA overflow event.
+auto Timer::step() noexcept -> void
+{
+    sync();
+    schedule_overflow();
+}
+
+/// @brief Returns the value of the DIV register.
+/// @return The DIV register.
+auto Timer::get_DIV() noexcept -> uint8_t
+{
+    sync();
+    return DIV;
+}
+
+/// @brief Returns the value of the TIMA register.
+/// @return The TIMA register.
+auto Timer::get_TIMA() noexcept -> uint8_t
+{
+    sync();
+    return TIMA;
+}
+
+/// @brief Resets the DIV register to $00.
+auto Timer::set_DIV() noexcept -> void
+{
+    sync();
+    DIV = 0;
+}
+
+/// @brief Updates TIMA and reschedules the next overflow.
+/// @param data The new TIMA value.
+auto Timer::set_TIMA(const uint8_t data) noexcept -> void
+{
+    sync();
+    TIMA = data;
+    schedule_overflow();
+}
+
+/// @brief Updates TMA.
+/// @param data The new TMA value.
+auto Timer::set_TMA(const uint8_t data) noexcept -> void
+{
+    sync();
+    TMA = data;
+}
+
+/// @brief Updates TAC and reschedules the next overflow.
+/// @param data The new TAC value.
+auto Timer::set_TAC(const uint8_t data) noexcept -> void
+{
+    sync();
+    TAC.byte = data;
+    schedule_overflow();
+}
+
+/// @brief Schedules the next TIMA overflow, if the timer is active.
+auto Timer::schedule_overflow() noexcept -> void
+{
+    if (!TAC.active)
+    {
+        bus.sched.cancel(Event::TimerOverflow);
+        return;
+    }
+
+    const int64_t ticks{ 0x100 - TIMA };
+    const int64_t delay{ (ticks * threshold()) - tima_counter };
+
+    // The counter may already be past the new threshold if TAC was just
+    // changed, in which case the increments happen on the next m-cycle.
+    bus.sched.schedule(Event::TimerOverflow, delay < 4 ? 4 : delay);
+}
+
+/// @brief Returns the number of T-cycles between TIMA increments.
+/// @return The number of T-cycles.
+auto Timer::threshold() const noexcept -> unsigned int
+{
+    switch (TAC.input_clock)
+    {
+        case 0:  return 1024;
+        case 1:  return 16;
+        case 2:  return 64;
+        default: return 256;
     }
-}
\ No newline at end of file
+}